@@ -0,0 +1,165 @@
+#pragma once
+
+#include <array>
+#include <iterator>
+#include <string>
+#include <utility>
+#include <vector>
+#include "bits.h"
+
+// One-pass adaptive Huffman coding (FGK). Encoder and decoder keep identical trees that
+// are updated after every byte, so nothing is sent up front and output starts with the
+// first byte. A byte seen for the first time is sent as the code of the NYT ("not yet
+// transmitted") leaf followed by its 8 bits.
+
+class adaptive_huffman_tree {
+private:
+	struct node {
+		std::size_t weight;
+		int parent;
+		int left;
+		int right;
+		int symbol;
+	};
+	// nodes in non-increasing order of weight (the sibling property), the root first and
+	// the NYT leaf last
+	std::vector<node> nodes;
+	std::array<int, 256> leaves;
+	int nyt;
+public:
+	adaptive_huffman_tree() : nodes{{0, -1, -1, -1, -1}}, nyt{0} {
+		leaves.fill(-1);
+	}
+
+	bool contains(unsigned char x) const {
+		return leaves[x] != -1;
+	}
+
+	std::string code(unsigned char x) const {
+		// the code of the leaf of {x}, or of the NYT leaf when {x} has not been seen
+		std::string result;
+		auto i = contains(x) ? leaves[x] : nyt;
+		while (nodes[i].parent != -1) {
+			auto parent = nodes[i].parent;
+			result += nodes[parent].right == i ? '1' : '0';
+			i = parent;
+		}
+		return std::string(result.rbegin(), result.rend());
+	}
+
+	template <typename I>
+	// requires InputIterator<I>
+	int find_leaf(I& first) const {
+		// reads a code, returns the symbol of its leaf or -1 for the NYT leaf
+		auto i = 0;
+		while (nodes[i].left != -1) {
+			i = *first == '1' ? nodes[i].right : nodes[i].left;
+			++first;
+		}
+		return nodes[i].symbol;
+	}
+
+	void update(unsigned char x) {
+		int q;
+		if (contains(x)) {
+			q = leaves[x];
+		} else {
+			// the NYT leaf gives birth to the new leaf and a new NYT leaf
+			auto parent = nyt;
+			int size = nodes.size();
+			nodes.push_back({0, parent, -1, -1, x});
+			nodes.push_back({0, parent, -1, -1, -1});
+			nodes[parent].right = size;
+			nodes[parent].left = size + 1;
+			leaves[x] = size;
+			nyt = size + 1;
+			q = size;
+		}
+
+		while (q != -1) {
+			// move q to the front of its block of equal weights before incrementing it
+			auto leader = q;
+			while (leader && nodes[leader - 1].weight == nodes[q].weight) --leader;
+			if (leader != q && leader != nodes[q].parent) {
+				swap_nodes(q, leader);
+				q = leader;
+			}
+			++nodes[q].weight;
+			q = nodes[q].parent;
+		}
+	}
+
+private:
+	void swap_nodes(int i, int j) {
+		// exchange the equally weighted subtrees at positions {i} and {j}, each position
+		// keeps its parent
+		std::swap(nodes[i].left, nodes[j].left);
+		std::swap(nodes[i].right, nodes[j].right);
+		std::swap(nodes[i].symbol, nodes[j].symbol);
+		relink(i);
+		relink(j);
+	}
+
+	void relink(int i) {
+		if (nodes[i].left != -1) {
+			nodes[nodes[i].left].parent = i;
+			nodes[nodes[i].right].parent = i;
+		} else if (nodes[i].symbol == -1) {
+			nyt = i;
+		} else {
+			leaves[nodes[i].symbol] = i;
+		}
+	}
+};
+
+class adaptive_huffman_encoder {
+private:
+	adaptive_huffman_tree tree;
+public:
+	template <typename I>
+	// requires InputIterator<I>
+	std::string operator()(I first, I last) {
+		// codes a batch of bytes; successive batches continue the same stream
+		std::string result;
+		while (first != last) {
+			auto x = static_cast<unsigned char>(*first);
+			result += tree.code(x);
+			if (!tree.contains(x)) write_bits<8>(result, x);
+			tree.update(x);
+			++first;
+		}
+		return result;
+	}
+};
+
+class adaptive_huffman_decoder {
+private:
+	adaptive_huffman_tree tree;
+public:
+	template <typename I, typename O>
+	// requires RandomAccessIterator<I>
+	// requires OutputIterator<O>
+	O operator()(I first, I last, O result) {
+		// precondition: [first, last) holds whole codes
+		while (first != last) {
+			auto x = tree.find_leaf(first);
+			if (x == -1) x = static_cast<int>(read_bits<8>(first));
+			*result = static_cast<char>(x);
+			++result;
+			tree.update(static_cast<unsigned char>(x));
+		}
+		return result;
+	}
+};
+
+inline std::string compress_adaptive(const std::string& input) {
+	adaptive_huffman_encoder encoder;
+	return encoder(input.begin(), input.end());
+}
+
+inline std::string decompress_adaptive(const std::string& input) {
+	adaptive_huffman_decoder decoder;
+	std::string result;
+	decoder(input.begin(), input.end(), std::back_inserter(result));
+	return result;
+}
@@ -0,0 +1,177 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+#include "bits.h"
+#include "histogram.h"
+
+// Table based asymmetric numeral systems (tANS). The histogram is normalized to counts
+// summing to 2^{log}, the symbols are spread over that many states and every symbol
+// moves the state through a table lookup, spending a fractional number of bits. The
+// encoder runs backwards over the input, so its bits are written in reverse to let the
+// decoder run forwards.
+
+constexpr std::size_t default_ans_log = 11;
+
+struct ans_entry {
+	// a decoding state: its symbol, and the bits to read and add to {base} for the next state
+	unsigned char symbol;
+	unsigned char bits;
+	std::uint32_t base;
+};
+
+struct ans_buffers {
+	// the temporaries of ans_payload and ans_decode, kept by the caller for reuse
+	std::vector<std::uint32_t> states; // ans_payload
+	std::vector<std::pair<std::uint32_t, std::size_t>> chunks; // ans_payload
+	std::vector<ans_entry> table; // ans_decode
+	std::vector<unsigned char> spread; // ans_payload and ans_decode
+};
+
+inline byte_histogram normalize_counts(const byte_histogram& h, std::size_t log) {
+	// precondition: distinct_symbols(h) <= 1 << log
+	std::size_t total = 0;
+	for (auto x : h) total += x;
+	auto size = std::size_t{1} << log;
+
+	byte_histogram result{};
+	std::size_t sum = 0;
+	for (std::size_t i = 0; i < h.size(); ++i) {
+		if (!h[i]) continue;
+		result[i] = std::max<std::size_t>(1, (h[i] * size + total / 2) / total);
+		sum += result[i];
+	}
+	// take the rounding error from the most frequent symbols
+	while (sum != size) {
+		std::size_t largest = 0;
+		for (std::size_t i = 1; i < result.size(); ++i) {
+			if (result[i] > result[largest]) largest = i;
+		}
+		if (sum > size) {
+			auto x = std::min(sum - size, result[largest] / 2);
+			result[largest] -= x;
+			sum -= x;
+		} else {
+			result[largest] += size - sum;
+			sum = size;
+		}
+	}
+	return result;
+}
+
+inline void spread_symbols(const byte_histogram& counts, std::size_t log, std::vector<unsigned char>& result) {
+	auto size = std::size_t{1} << log;
+	auto step = (size >> 1) + (size >> 3) + 3; // odd, so every state is visited once
+	result.resize(size);
+	std::size_t position = 0;
+	for (std::size_t i = 0; i < counts.size(); ++i) {
+		for (std::size_t j = 0; j < counts[i]; ++j) {
+			result[position] = static_cast<unsigned char>(i);
+			position = (position + step) & (size - 1);
+		}
+	}
+}
+
+inline double ans_cost(const byte_histogram& h, std::size_t log = default_ans_log) {
+	// estimated size in bits of the payload written by ans_payload
+	auto counts = normalize_counts(h, log);
+	double bits = 4 + 9 + log;
+	for (std::size_t i = 0; i < h.size(); ++i) {
+		if (h[i]) bits += 8 + (log + 1) + h[i] * (log - std::log2(static_cast<double>(counts[i])));
+	}
+	return bits;
+}
+
+template <typename I>
+// requires BidirectionalIterator<I>
+std::string ans_payload(I first, I last, const byte_histogram& h, ans_buffers& buffers, std::size_t log = default_ans_log) {
+	// returns an empty string when a byte of [first, last) has no count in {h}, as a
+	// sampled histogram may miss one
+	auto counts = normalize_counts(h, log);
+	auto size = std::size_t{1} << log;
+
+	// states[starts[s] + x - counts[s]] is the state that decodes to s through x
+	byte_histogram starts{};
+	for (std::size_t i = 1; i < counts.size(); ++i) starts[i] = starts[i - 1] + counts[i - 1];
+	auto next = counts;
+	auto& states = buffers.states;
+	states.assign(size, 0);
+	auto& spread = buffers.spread;
+	spread_symbols(counts, log, spread);
+	for (std::size_t i = 0; i < size; ++i) {
+		auto s = spread[i];
+		states[starts[s] + next[s]++ - counts[s]] = static_cast<std::uint32_t>(size + i);
+	}
+
+	auto& chunks = buffers.chunks;
+	chunks.clear();
+	std::size_t x = size;
+	std::size_t bits = 4 + 9 + log;
+	while (first != last) {
+		--last;
+		auto s = static_cast<unsigned char>(*last);
+		if (!counts[s]) return std::string{};
+		std::size_t n = 0;
+		while ((x >> n) >= 2 * counts[s]) ++n;
+		chunks.emplace_back(static_cast<std::uint32_t>(x & ((std::size_t{1} << n) - 1)), n);
+		bits += n;
+		x = states[starts[s] + (x >> n) - counts[s]];
+	}
+
+	// the header and chunks are written once their size is known, into a single allocation
+	std::string result;
+	result.reserve(bits + distinct_symbols(counts) * (8 + log + 1));
+	write_bits<4>(result, log);
+	write_bits<9>(result, distinct_symbols(counts));
+	for (std::size_t i = 0; i < counts.size(); ++i) {
+		if (!counts[i]) continue;
+		write_bits<8>(result, i);
+		write_bits(result, counts[i], log + 1);
+	}
+	write_bits(result, x - size, log);
+	for (auto chunk = chunks.rbegin(); chunk != chunks.rend(); ++chunk) write_bits(result, chunk->first, chunk->second);
+	return result;
+}
+
+template <typename I, typename O>
+// requires RandomAccessIterator<I>
+// requires OutputIterator<O>
+O ans_decode(I& first, std::size_t n, O result, ans_buffers& buffers) {
+	std::size_t log = read_bits<4>(first);
+	auto size = std::size_t{1} << log;
+	byte_histogram counts{};
+	auto m = read_bits<9>(first);
+	while (m) {
+		--m;
+		auto x = read_bits<8>(first);
+		counts[x] = read_bits(first, log + 1);
+	}
+
+	auto next = counts;
+	auto& table = buffers.table;
+	table.resize(size);
+	auto& spread = buffers.spread;
+	spread_symbols(counts, log, spread);
+	for (std::size_t i = 0; i < size; ++i) {
+		auto s = spread[i];
+		auto x = next[s]++;
+		std::size_t bits = 0;
+		while ((x << bits) < size) ++bits;
+		table[i] = {s, static_cast<unsigned char>(bits), static_cast<std::uint32_t>((x << bits) - size)};
+	}
+
+	std::size_t x = read_bits(first, log);
+	while (n) {
+		--n;
+		const auto& e = table[x];
+		*result = static_cast<char>(e.symbol);
+		++result;
+		x = e.base + read_bits(first, e.bits);
+	}
+	return result;
+}
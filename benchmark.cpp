@@ -0,0 +1,118 @@
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+#include "adaptive_huffman.h"
+#include "compress.h"
+#include "tunstall.h"
+
+template <typename F>
+// requires Procedure<F>
+double seconds(F f) {
+	auto start = std::chrono::steady_clock::now();
+	f();
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void report(const std::string& name, const std::string& input, const std::string& compressed, double encode, double decode, bool ok) {
+	double mb = input.size() / 1e6;
+	std::cout << name << ": " << (ok ? "" : "MISMATCH ")
+		<< static_cast<double>(compressed.size()) / input.size() << " bits/byte, "
+		<< "encode " << mb / encode << " MB/s, "
+		<< "decode " << mb / decode << " MB/s\n";
+}
+
+std::string sample_input() {
+	// skewed bytes with some local structure
+	std::mt19937 rng{42};
+	std::geometric_distribution<int> symbol{0.15};
+	std::string result;
+	for (std::size_t i = 0; i < (1 << 22); ++i) result += static_cast<char>('a' + symbol(rng) % 26);
+	return result;
+}
+
+void semi_static(const std::string& input) {
+	std::string compressed, result;
+	auto encode = seconds([&] { compressed = compress_blocks(input); });
+	auto decode = seconds([&] { result = decompress_blocks(compressed); });
+	report("semi-static blocks", input, compressed, encode, decode, result == input);
+
+	// nothing can be written until a whole block has been seen
+	auto block = input.substr(0, std::min(input.size(), default_block_size));
+	auto latency = seconds([&] { compress_blocks(block); });
+	std::cout << "  first output after " << block.size() << " bytes, " << latency * 1e6 << " us\n";
+}
+
+void adaptive(const std::string& input) {
+	std::string compressed, result;
+	auto encode = seconds([&] { compressed = compress_adaptive(input); });
+	auto decode = seconds([&] { result = decompress_adaptive(compressed); });
+	report("adaptive", input, compressed, encode, decode, result == input);
+
+	adaptive_huffman_encoder encoder;
+	auto latency = seconds([&] { encoder(input.begin(), input.begin() + std::min<std::size_t>(input.size(), 1)); });
+	std::cout << "  first output after 1 byte, " << latency * 1e6 << " us\n";
+}
+
+void tunstall(const std::string& input) {
+	std::string compressed, result;
+	auto encode = seconds([&] { compressed = compress_tunstall(input); });
+	auto decode = seconds([&] { result = decompress_tunstall(compressed); });
+	report("tunstall", input, compressed, encode, decode, result == input);
+}
+
+void tables(const std::string& input) {
+	// the tables of many small messages, built one at a time and as one batch
+	std::vector<byte_histogram> histograms;
+	for (std::size_t i = 0; i + 1024 <= input.size() && histograms.size() < 20000; i += 1024) {
+		histograms.push_back(count_bytes(input.begin() + i, input.begin() + i + 1024));
+	}
+	if (histograms.empty()) return;
+
+	// best of three rounds; both sides allocate their tables and headers inside the timer
+	std::vector<code_table> single_codes, batch_codes;
+	std::vector<std::string> single_headers, batch_headers;
+	double single = 0, batch = 0;
+	for (int round = 0; round < 3; ++round) {
+		single_codes.clear();
+		single_headers.clear();
+		auto x = seconds([&] {
+			single_codes.resize(histograms.size());
+			single_headers.resize(histograms.size());
+			for (std::size_t i = 0; i < histograms.size(); ++i) single_headers[i] = build_table(histograms[i], single_codes[i]);
+		});
+		batch_codes.clear();
+		batch_headers.clear();
+		auto y = seconds([&] { batch_headers = build_tables(histograms, batch_codes); });
+		single = round ? std::min(single, x) : x;
+		batch = round ? std::min(batch, y) : y;
+	}
+	std::cout << "tables of " << histograms.size() << " 1 KiB messages: "
+		<< histograms.size() / single << " tables/s one at a time, "
+		<< histograms.size() / batch << " tables/s batched\n";
+}
+
+int main(int argc, char* argv[]) {
+	std::string input;
+	if (argc == 2) {
+		std::ifstream file{argv[1], std::ios::binary};
+		input.assign(std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{});
+	} else {
+		input = sample_input();
+	}
+	if (input.empty()) {
+		std::cout << "empty input\n";
+		return 1;
+	}
+
+	std::cout << "--Input--\n" << input.size() << " bytes\n\n";
+	semi_static(input);
+	adaptive(input);
+	tunstall(input);
+	tables(input);
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+// Bit streams are strings of '0' and '1' characters, most significant bit first.
+
+inline void write_bits(std::string& result, unsigned long long x, std::size_t n) {
+	// writes the low {n} bits of {x}
+	while (n) {
+		--n;
+		result += (x >> n) & 1 ? '1' : '0';
+	}
+}
+
+template <typename I>
+// requires InputIterator<I>
+unsigned long long read_bits(I& first, std::size_t n) {
+	unsigned long long x = 0;
+	while (n) {
+		--n;
+		x = (x << 1) | (*first == '1');
+		++first;
+	}
+	return x;
+}
+
+template <std::size_t N>
+void write_bits(std::string& result, unsigned long long x) {
+	write_bits(result, x, N);
+}
+
+template <std::size_t N, typename I>
+// requires RandomAccessIterator<I>
+unsigned long long read_bits(I& first) {
+	return read_bits(first, N);
+}
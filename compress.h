@@ -0,0 +1,1024 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "ans.h"
+#include "bits.h"
+#include "histogram.h"
+#include "huffman.h"
+#include "scratch.h"
+
+template <typename I>
+using DifferenceType = typename std::iterator_traits<I>::difference_type;
+
+template <typename I>
+// requires ForwardIterator<I>
+std::pair<DifferenceType<I>, I> adjacent_count(I first, I last) {
+	DifferenceType<I> n{0};
+	if (first == last) return std::make_pair(n, first);
+	while (std::next(first) != last && *first == *std::next(first)) {
+		++n; ++first;
+	}
+	return std::make_pair(++n, ++first);
+}
+
+template <typename I, typename O>
+// requires ForwardIterator<I>
+// requires OutputIterator<O>
+O unique_copy_with_count(I first, I last, O result) {
+	while (true) {
+		auto count = adjacent_count(first, last);
+		if (!count.first) return result;
+		*result = std::make_pair(count.first, *first);
+		++result;
+		first = count.second;
+	}
+}
+
+template <typename T, typename Op>
+// requires Regular<T>
+// requires MonoidOpreation<Op, T>
+class merge_first_op {
+private:
+	Op op;
+public:
+	explicit merge_first_op(const Op& op) : op{op} { }
+
+	template <typename U>
+	// requires Regular<U>	
+	std::pair<T, U> operator()(const std::pair<T, U>& x, const std::pair<T, U>& y) const {
+		return std::make_pair(op(x.first, y.first), U{});
+	}
+};
+
+template <typename T, typename U, typename Compare>
+// requires Regular<T>
+// requires Regular<U>
+// requires TotalOrdering<Compare, T>
+class compare_first {
+private:
+	Compare cmp;
+public:
+	explicit compare_first(const Compare& cmp) : cmp{cmp} { }
+
+	bool operator()(const std::pair<T, U>& x, const std::pair<T, U>& y) const {
+		return cmp(x.first, y.first);
+	}
+};
+
+template <typename T, typename U>
+// requires Regular<T>
+// requires Regular<U>
+struct get_second {
+	const U& operator()(const std::pair<T, U>& x) const {
+		return x.second;
+	}
+};
+
+struct packed_node {
+	// an 8-byte node of the huffman array, so the 511 nodes of a byte table fit in 64
+	// cache lines instead of 128; internal nodes have symbol 0
+	std::uint32_t weight;
+	std::uint16_t symbol;
+};
+
+struct packed_less {
+	bool operator()(const packed_node& x, const packed_node& y) const {
+		return x.weight < y.weight;
+	}
+};
+
+struct packed_merge {
+	packed_node operator()(const packed_node& x, const packed_node& y) const {
+		return packed_node{x.weight + y.weight, 0};
+	}
+};
+
+template <typename U>
+// requires Integral<U>
+struct packed_symbol {
+	U operator()(const packed_node& x) const {
+		return static_cast<U>(x.symbol);
+	}
+};
+
+template <typename T, typename U, typename F>
+// requires Integral<T>
+// requires Integral<U>
+// requires BinaryFunction<F, huffman_encoder, UnaryFunction>
+std::string with_huffman_encoder(const std::vector<std::pair<T, U>>& frequencies, F f) {
+	// calls f(encoder, symbol) with a huffman_encoder over {frequencies} and the function
+	// giving the symbol of a leaf; the nodes are packed_node when the total count fits in
+	// 32 bits and the symbols in 16, and (count, symbol) pairs otherwise
+	// precondition: the frequencies are sorted by increasing count
+	unsigned long long total = 0;
+	for (const auto& x : frequencies) total += static_cast<unsigned long long>(x.first);
+	if (sizeof(U) <= 2 && total >> 32 == 0) {
+		std::vector<packed_node> nodes;
+		nodes.reserve(2 * frequencies.size());
+		for (const auto& x : frequencies) {
+			nodes.push_back({static_cast<std::uint32_t>(x.first), static_cast<std::uint16_t>(static_cast<typename std::make_unsigned<U>::type>(x.second))});
+		}
+		huffman_encoder<packed_node, packed_less, packed_merge> encoder{std::move(nodes), packed_less{}, packed_merge{}};
+		return f(encoder, packed_symbol<U>{});
+	}
+
+	using Op = merge_first_op<T, std::plus<T>>;
+	using Compare = compare_first<T, U, std::less<T>>;
+	huffman_encoder<std::pair<T, U>, Compare, Op> encoder{frequencies, Compare{std::less<T>{}}, Op{std::plus<T>{}}};
+	return f(encoder, get_second<T, U>{});
+}
+
+template <typename T, typename U>
+// requires Integral<T>
+// requires Regular<U>
+void sort_frequencies(std::vector<std::pair<T, U>>& frequencies) {
+	// stable sort by increasing count, the order huffman_encoder requires; counts that fit
+	// in 32 bits are radix sorted a byte at a time, skipping bytes that are zero in all of them
+	// precondition: every count is nonnegative
+	unsigned long long all = 0;
+	for (const auto& x : frequencies) all |= static_cast<unsigned long long>(x.first);
+	if (all >> 32) {
+		std::stable_sort(frequencies.begin(), frequencies.end(), [](const std::pair<T, U>& x, const std::pair<T, U>& y) {
+			return x.first < y.first;
+		});
+		return;
+	}
+
+	std::vector<std::pair<T, U>> buffer(frequencies.size());
+	for (unsigned shift = 0; shift < 32; shift += 8) {
+		if (!((all >> shift) & 0xff)) continue;
+		std::array<std::size_t, 257> starts{};
+		for (const auto& x : frequencies) ++starts[((static_cast<unsigned long long>(x.first) >> shift) & 0xff) + 1];
+		for (std::size_t i = 1; i < starts.size(); ++i) starts[i] += starts[i - 1];
+		for (const auto& x : frequencies) buffer[starts[(static_cast<unsigned long long>(x.first) >> shift) & 0xff]++] = x;
+		frequencies.swap(buffer);
+	}
+}
+
+template <typename U>
+// requires Integral<U>
+struct fixed_codec {
+	// Writes every leaf of a header as its sizeof(U) * 8 bits. A symbol codec writes a
+	// symbol with write(result, x) and reads one back from the bit stream with
+	// read(first); it is copied fresh for every header, so it may keep state such as
+	// the previous leaf from one call to the next.
+	void write(std::string& result, U x) const {
+		write_bits(result, static_cast<typename std::make_unsigned<U>::type>(x), sizeof(U) * 8);
+	}
+
+	template <typename I>
+	// requires InputIterator<I>
+	U read(I& first) const {
+		return static_cast<U>(read_bits(first, sizeof(U) * 8));
+	}
+};
+
+using byte_codec = fixed_codec<char>;
+using digram_codec = fixed_codec<std::uint16_t>;
+
+// Functions for with_huffman_encoder, named rather than generic lambdas so the headers
+// stay C++11.
+
+struct encode_bytes {
+	// codes the bytes of {input}
+	const std::string& input;
+
+	template <typename Encoder, typename F>
+	std::string operator()(Encoder& encoder, F symbol) const {
+		return encoder(input.begin(), input.end(), symbol, byte_codec{});
+	}
+};
+
+template <typename SymbolCodec, typename Map>
+struct build_codes {
+	// fills {codes} and returns the header
+	Map& codes;
+
+	template <typename Encoder, typename F>
+	std::string operator()(Encoder& encoder, F symbol) const {
+		return encoder.build(symbol, SymbolCodec{}, codes);
+	}
+};
+
+inline std::string compress(const std::string& input, const byte_histogram& h) {
+	// codes {input} with the counts of {h}, for callers that already know the statistics;
+	// throws std::invalid_argument when a byte of {input} has no count in {h}, such as
+	// from a stale cached histogram
+	using T = DifferenceType<typename std::string::iterator>;
+
+	if (input.empty()) return std::string{};
+	for (char x : input) {
+		if (!h[static_cast<unsigned char>(x)]) throw std::invalid_argument("compress: byte missing from the histogram");
+	}
+	std::vector<std::pair<T, char>> frequencies;
+	for (std::size_t i = 0; i < h.size(); ++i) {
+		if (h[i]) frequencies.emplace_back(h[i], static_cast<char>(i));
+	}
+	// the stream has no symbol count, so a lone symbol needs a sibling to get a one bit code
+	if (frequencies.size() == 1) frequencies.emplace_back(0, static_cast<char>(frequencies.front().second + 1));
+
+	sort_frequencies(frequencies);
+	return with_huffman_encoder(frequencies, encode_bytes{input});
+}
+
+inline std::string compress(const std::string& input) {
+	return compress(input, count_bytes(input.begin(), input.end()));
+}
+
+class code_table {
+	// The code of every byte indexed by the byte, in place of a hash map: filling a table
+	// allocates nothing, as codes of up to 15 bits fit in the strings themselves, and a
+	// lookup is an index.
+private:
+	std::array<std::string, 256> codes;
+	std::bitset<256> present;
+public:
+	void insert(std::pair<char, std::string> x) {
+		auto i = static_cast<unsigned char>(x.first);
+		codes[i] = std::move(x.second);
+		present.set(i);
+	}
+
+	bool contains(char x) const {
+		return present.test(static_cast<unsigned char>(x));
+	}
+
+	const std::string& at(char x) const {
+		// throws std::out_of_range when {x} has no code, as unordered_map::at does
+		if (!contains(x)) throw std::out_of_range("code_table: byte has no code");
+		return codes[static_cast<unsigned char>(x)];
+	}
+
+	const std::string& operator[](char x) const {
+		// precondition: contains(x)
+		return codes[static_cast<unsigned char>(x)];
+	}
+
+	bool empty() const {
+		return present.none();
+	}
+
+	void clear() {
+		for (std::size_t i = 0; i < codes.size(); ++i) codes[i].clear();
+		present.reset();
+	}
+};
+
+inline std::string build_table(const byte_histogram& h, code_table& codes) {
+	// canonical table of the counts of {h}, read back with huffman_decoder::read_canonical_table
+	// precondition: distinct_symbols(h) != 0
+	auto& frequencies = thread_scratch().frequencies;
+	frequencies.clear();
+	for (std::size_t i = 0; i < h.size(); ++i) {
+		if (h[i]) frequencies.emplace_back(h[i], static_cast<char>(i));
+	}
+	sort_frequencies(frequencies);
+	code_lengths_in_place(frequencies.begin(), frequencies.end(), [](std::pair<std::size_t, char>& x) -> std::size_t& {
+		return x.first;
+	});
+	return canonical_table(frequencies.begin(), frequencies.end(), get_second<std::size_t, char>{}, byte_codec{}, codes);
+}
+
+using code_lengths = std::array<std::size_t, 256>;
+
+inline std::string build_table_from_lengths(const code_lengths& lengths, code_table& codes) {
+	// builds the table that gives every byte of nonzero length a code of exactly that length;
+	// throws std::invalid_argument unless some length is nonzero, every length is below 64
+	// and sum_i 2^{-lengths[i]} <= 1, without which no prefix code has these lengths
+	std::vector<std::pair<std::size_t, char>> sorted;
+	// the Kraft sum in units of 2^-63, checked after every term so it cannot wrap
+	unsigned long long kraft = 0;
+	for (std::size_t i = 0; i < lengths.size(); ++i) {
+		if (!lengths[i]) continue;
+		if (lengths[i] >= 64) throw std::invalid_argument("build_table_from_lengths: length of 64 bits or more");
+		kraft += 1ull << (63 - lengths[i]);
+		if (kraft > 1ull << 63) throw std::invalid_argument("build_table_from_lengths: lengths violate the Kraft inequality");
+		sorted.emplace_back(lengths[i], static_cast<char>(i));
+	}
+	if (sorted.empty()) throw std::invalid_argument("build_table_from_lengths: no nonzero length");
+	std::stable_sort(sorted.begin(), sorted.end(), [](const std::pair<std::size_t, char>& x, const std::pair<std::size_t, char>& y) {
+		return x.first > y.first;
+	});
+	return canonical_table(sorted.begin(), sorted.end(), get_second<std::size_t, char>{}, byte_codec{}, codes);
+}
+
+constexpr std::size_t table_batch = 64;
+
+inline std::vector<std::string> build_tables(const std::vector<byte_histogram>& histograms, std::vector<code_table>& codes) {
+	// builds the table of every histogram, as build_table does, {table_batch} tables at a
+	// time: the symbols of a batch are radix sorted by count together and then stably by
+	// table, so the tables of a batch share two sorts that stay in cache
+	// precondition: distinct_symbols(h) != 0 for every h in {histograms}
+	struct get_symbol {
+		char operator()(const std::pair<std::size_t, std::uint32_t>& x) const {
+			return static_cast<char>(x.second & 0xff);
+		}
+	};
+
+	std::vector<std::string> result(histograms.size());
+	codes.assign(histograms.size(), code_table{});
+	// the second member is the table within the batch in the high bits and the symbol in
+	// the low 8 bits
+	std::vector<std::pair<std::size_t, std::uint32_t>> frequencies, sorted;
+	std::array<std::size_t, table_batch + 1> starts;
+	for (std::size_t batch = 0; batch < histograms.size(); batch += table_batch) {
+		auto n = std::min(table_batch, histograms.size() - batch);
+		frequencies.clear();
+		for (std::size_t i = 0; i < n; ++i) {
+			const auto& h = histograms[batch + i];
+			for (std::size_t j = 0; j < h.size(); ++j) {
+				if (h[j]) frequencies.emplace_back(h[j], static_cast<std::uint32_t>(i << 8 | j));
+			}
+		}
+		sort_frequencies(frequencies);
+
+		starts.fill(0);
+		for (const auto& x : frequencies) ++starts[(x.second >> 8) + 1];
+		for (std::size_t i = 1; i <= n; ++i) starts[i] += starts[i - 1];
+		auto next = starts;
+		sorted.resize(frequencies.size());
+		for (const auto& x : frequencies) sorted[next[x.second >> 8]++] = x;
+
+		for (std::size_t i = 0; i < n; ++i) {
+			auto first = sorted.begin() + starts[i];
+			auto last = sorted.begin() + starts[i + 1];
+			code_lengths_in_place(first, last, [](std::pair<std::size_t, std::uint32_t>& x) -> std::size_t& {
+				return x.first;
+			});
+			result[batch + i] = canonical_table(first, last, get_symbol{}, byte_codec{}, codes[batch + i]);
+		}
+	}
+	return result;
+}
+
+inline std::string decompress(const std::string& input) {
+	if (input.empty()) return std::string{};
+	huffman_decoder<char> decoder;
+	std::string result;
+	decoder(input, std::back_inserter(result), byte_codec{});
+	return result;
+}
+
+template <typename I>
+// requires InputIterator<I>
+std::string encode_with(const code_table& codes, I first, I last) {
+	std::string result;
+	while (first != last) {
+		result += codes.at(*first);
+		++first;
+	}
+	return result;
+}
+
+template <typename I, typename O>
+// requires InputIterator<I>
+// requires OutputIterator<O>
+O decode_with(const huffman_decoder<char>& decoder, I& first, std::size_t n, O result) {
+	while (n) {
+		--n;
+		*result = decoder.decode(first);
+		++result;
+	}
+	return result;
+}
+
+// A frame is a 32-bit block count and the tables shared by its blocks, followed by
+// independently coded blocks. Each block carries its type, the number of symbols it
+// decodes to and the size of its payload in bits, so blocks can be skipped or decoded
+// without reading the rest of the frame.
+enum class block_type : unsigned long long {
+	huffman = 0,
+	single_symbol = 1,
+	shared_table = 2,
+	repeat_table = 3,
+	rle = 4,
+	digram = 5,
+	tans = 6,
+	raw = 7,
+	packed = 8,
+	mtf = 9
+};
+
+constexpr std::size_t block_type_bits = 4;
+constexpr std::size_t default_block_size = 1 << 16;
+constexpr std::size_t max_shared_tables = 16;
+constexpr std::size_t min_sampled_block = 1 << 20;
+
+template <typename I>
+// requires RandomAccessIterator<I>
+bool sampled_block(I first, I last, bool sample) {
+	// with {sample} set, blocks of at least {min_sampled_block} bytes are estimated from a sample
+	return sample && static_cast<std::size_t>(last - first) >= min_sampled_block;
+}
+
+template <typename I>
+// requires RandomAccessIterator<I>
+byte_histogram block_histogram(I first, I last, bool sample) {
+	// the histogram a table of the block is built from
+	if (sampled_block(first, last, sample)) return with_escapes(sample_bytes(first, last));
+	return count_bytes(first, last);
+}
+
+inline std::string make_block(block_type type, std::size_t n, const std::string& payload) {
+	std::string result;
+	result.reserve(block_type_bits + 32 + 32 + payload.size());
+	write_bits<block_type_bits>(result, static_cast<unsigned long long>(type));
+	write_bits<32>(result, n);
+	write_bits<32>(result, payload.size());
+	result += payload;
+	return result;
+}
+
+constexpr std::size_t block_header_bits = block_type_bits + 32 + 32;
+
+inline void sort_counts(std::array<std::size_t, 256>& counts, std::size_t n) {
+	// sorts the first {n} counts; many counts are radix sorted a byte at a time, skipping
+	// bytes that are zero in all of them
+	if (n < 64) {
+		std::sort(counts.begin(), counts.begin() + n);
+		return;
+	}
+	std::size_t all = 0;
+	for (std::size_t i = 0; i < n; ++i) all |= counts[i];
+	std::array<std::size_t, 256> buffer;
+	auto from = counts.data();
+	auto to = buffer.data();
+	for (unsigned shift = 0; shift < 64 && all >> shift; shift += 8) {
+		if (!((all >> shift) & 0xff)) continue;
+		std::array<std::size_t, 257> starts{};
+		for (std::size_t i = 0; i < n; ++i) ++starts[((from[i] >> shift) & 0xff) + 1];
+		for (std::size_t i = 1; i < starts.size(); ++i) starts[i] += starts[i - 1];
+		for (std::size_t i = 0; i < n; ++i) to[starts[(from[i] >> shift) & 0xff]++] = from[i];
+		std::swap(from, to);
+	}
+	if (from != counts.data()) std::copy(from, from + n, counts.data());
+}
+
+inline std::size_t huffman_cost(const byte_histogram& h) {
+	// exact size in bits of a huffman block with this histogram, header included; only
+	// the code lengths are computed, no table is built
+	std::size_t bits = block_header_bits;
+	std::array<std::size_t, 256> counts;
+	std::array<std::size_t, 256> lengths{};
+	std::size_t n = 0;
+	for (auto x : h) {
+		if (x) counts[n++] = x;
+	}
+	if (n < 2) return bits + 8;
+
+	sort_counts(counts, n);
+	std::copy(counts.begin(), counts.begin() + n, lengths.begin());
+	code_lengths_in_place(lengths.begin(), lengths.begin() + n, [](std::size_t& x) -> std::size_t& {
+		return x;
+	});
+	// as canonical_table: the longest length and count width, a count per length and the symbols
+	std::array<std::size_t, 64> per_length{};
+	for (std::size_t i = 0; i < n; ++i) {
+		bits += counts[i] * lengths[i];
+		++per_length[lengths[i]];
+	}
+	std::size_t width = 0;
+	for (auto x : per_length) {
+		while (x >> width) ++width;
+	}
+	return bits + 6 + 5 + lengths[0] * width + 8 * n;
+}
+
+inline std::size_t reuse_cost(const byte_histogram& h, const code_table& codes) {
+	// size in bits of a block with this histogram coded with an existing table
+	std::size_t bits = block_header_bits;
+	for (std::size_t i = 0; i < h.size(); ++i) {
+		if (!h[i]) continue;
+		if (!codes.contains(static_cast<char>(i))) return std::numeric_limits<std::size_t>::max();
+		bits += h[i] * codes[static_cast<char>(i)].size();
+	}
+	return bits;
+}
+
+// Run-length blocks code each run as its symbol and the bucket floor(log2(length)) with
+// two separate tables, followed by the low bits of the length.
+
+template <typename I>
+// requires RandomAccessIterator<I>
+std::size_t count_runs(I first, I last) {
+	// branch-free so the compiler can vectorize the comparison of neighbours
+	if (first == last) return 0;
+	std::size_t n = 1;
+	auto size = last - first;
+	for (DifferenceType<I> i = 1; i < size; ++i) n += first[i] != first[i - 1];
+	return n;
+}
+
+template <typename I>
+// requires RandomAccessIterator<I>
+std::size_t sample_runs(I first, I last) {
+	// estimates count_runs(first, last) from the neighbours within the runs of for_each_sample
+	std::size_t pairs = 0;
+	std::size_t changes = 0;
+	for_each_sample(first, last, [&](I x, I y) {
+		pairs += static_cast<std::size_t>(y - x) - 1;
+		changes += count_runs(x, y) - 1;
+	});
+	if (!pairs) return count_runs(first, last);
+	return 1 + changes * static_cast<std::size_t>(last - first - 1) / pairs;
+}
+
+inline std::size_t run_bucket(std::size_t n) {
+	std::size_t bucket = 0;
+	while (n >>= 1) ++bucket;
+	return bucket;
+}
+
+template <typename I>
+// requires ForwardIterator<I>
+std::string rle_payload(I first, I last) {
+	std::vector<std::pair<DifferenceType<I>, ValueType<I>>> runs;
+	unique_copy_with_count(first, last, std::back_inserter(runs));
+
+	byte_histogram symbols{}, lengths{};
+	for (const auto& x : runs) {
+		++symbols[static_cast<unsigned char>(x.second)];
+		++lengths[run_bucket(x.first)];
+	}
+	code_table symbol_codes, length_codes;
+	std::string result = build_table(symbols, symbol_codes);
+	result += build_table(lengths, length_codes);
+
+	for (const auto& x : runs) {
+		auto bucket = run_bucket(x.first);
+		result += symbol_codes.at(x.second);
+		result += length_codes.at(static_cast<char>(bucket));
+		write_bits(result, x.first - (DifferenceType<I>{1} << bucket), bucket);
+	}
+	return result;
+}
+
+template <typename I, typename O>
+// requires RandomAccessIterator<I>
+// requires OutputIterator<O>
+O rle_decode(I& first, std::size_t n, O result) {
+	auto& symbols = thread_scratch().symbols;
+	auto& lengths = thread_scratch().lengths;
+	first = symbols.read_canonical_table(first, byte_codec{});
+	first = lengths.read_canonical_table(first, byte_codec{});
+	while (n) {
+		auto x = symbols.decode(first);
+		auto bucket = static_cast<unsigned char>(lengths.decode(first));
+		auto length = (std::size_t{1} << bucket) + read_bits(first, bucket);
+		result = std::fill_n(result, length, x);
+		n -= length;
+	}
+	return result;
+}
+
+// Digram blocks extend the alphabet to pairs of bytes so a byte that makes up most of
+// the block can cost less than one bit. An odd trailing byte is written as is.
+
+using digram_histogram = std::vector<std::size_t>;
+using digram_table = std::unordered_map<std::uint16_t, std::string>;
+
+template <typename I>
+// requires RandomAccessIterator<I>
+void count_digrams(I first, I last, digram_histogram& h) {
+	h.assign(1 << 16, 0);
+	for (; last - first > 1; first += 2) {
+		++h[static_cast<unsigned char>(first[0]) << 8 | static_cast<unsigned char>(first[1])];
+	}
+}
+
+template <typename I>
+// requires RandomAccessIterator<I>
+std::string digram_payload(I first, I last) {
+	using T = DifferenceType<typename std::string::iterator>;
+
+	auto& h = thread_scratch().digrams;
+	count_digrams(first, last, h);
+	std::vector<std::pair<T, std::uint16_t>> frequencies;
+	for (std::size_t i = 0; i < h.size(); ++i) {
+		if (h[i]) frequencies.emplace_back(h[i], static_cast<std::uint16_t>(i));
+	}
+	if (frequencies.size() > max_header_symbols) return std::string{};
+
+	sort_frequencies(frequencies);
+	digram_table codes;
+	std::string result = with_huffman_encoder(frequencies, build_codes<digram_codec, digram_table>{codes});
+
+	for (; last - first > 1; first += 2) {
+		result += codes.at(static_cast<unsigned char>(first[0]) << 8 | static_cast<unsigned char>(first[1]));
+	}
+	if (first != last) write_bits<8>(result, static_cast<unsigned char>(*first));
+	return result;
+}
+
+template <typename I, typename O>
+// requires RandomAccessIterator<I>
+// requires OutputIterator<O>
+O digram_decode(I& first, std::size_t n, O result) {
+	auto& decoder = thread_scratch().digram_decoder;
+	first = decoder.read_table(first, digram_codec{});
+	for (; n > 1; n -= 2) {
+		auto x = decoder.decode(first);
+		*result = static_cast<char>(x >> 8);
+		++result;
+		*result = static_cast<char>(x & 0xff);
+		++result;
+	}
+	if (n) {
+		*result = static_cast<char>(read_bits<8>(first));
+		++result;
+	}
+	return result;
+}
+
+constexpr std::size_t min_run_length = 16; // average run length of an all-run block
+
+template <typename I>
+// requires InputIterator<I>
+std::string raw_payload(I first, I last) {
+	std::string result;
+	while (first != last) {
+		write_bits<8>(result, static_cast<unsigned char>(*first));
+		++first;
+	}
+	return result;
+}
+
+// Packed blocks write the index of every byte in a dictionary of at most 16 values with
+// a fixed width of 1, 2 or 4 bits, for boolean and enum-like data where a table would
+// assign equal lengths anyway.
+
+inline std::size_t packed_width(std::size_t m) {
+	if (m <= 2) return 1;
+	if (m <= 4) return 2;
+	if (m <= 16) return 4;
+	return 0;
+}
+
+inline std::size_t packed_cost(const byte_histogram& h, std::size_t n) {
+	// precondition: packed_width(distinct_symbols(h)) != 0
+	auto m = distinct_symbols(h);
+	return 3 + 5 + 8 * m + n * packed_width(m);
+}
+
+template <typename I>
+// requires InputIterator<I>
+std::string packed_payload(I first, I last, const byte_histogram& h) {
+	// returns an empty string when a byte of [first, last) has no count in {h}, as a
+	// sampled histogram may miss one
+	// precondition: packed_width(distinct_symbols(h)) != 0
+	auto width = packed_width(distinct_symbols(h));
+	std::string result;
+	write_bits<3>(result, width);
+	write_bits<5>(result, distinct_symbols(h));
+	std::array<std::string, 256> codes;
+	std::size_t m = 0;
+	for (std::size_t i = 0; i < h.size(); ++i) {
+		if (!h[i]) continue;
+		write_bits<8>(result, i);
+		write_bits(codes[i], m++, width);
+	}
+	while (first != last) {
+		const auto& code = codes[static_cast<unsigned char>(*first)];
+		if (code.empty()) return std::string{};
+		result += code;
+		++first;
+	}
+	return result;
+}
+
+template <typename I, typename O>
+// requires RandomAccessIterator<I>
+// requires OutputIterator<O>
+O packed_decode(I& first, std::size_t n, O result) {
+	auto width = read_bits<3>(first);
+	std::vector<char> symbols(read_bits<5>(first));
+	for (auto& x : symbols) x = static_cast<char>(read_bits<8>(first));
+	while (n) {
+		--n;
+		*result = symbols[read_bits(first, width)];
+		++result;
+	}
+	return result;
+}
+
+// Move-to-front blocks replace every byte by its position in a list of recently seen
+// bytes, turning bursts of a few repeating values into a skewed distribution of small
+// ranks, which are then Huffman coded.
+
+template <typename I, typename O>
+// requires InputIterator<I>
+// requires OutputIterator<O>
+O mtf_encode(I first, I last, O result) {
+	std::array<unsigned char, 256> list;
+	for (std::size_t i = 0; i < list.size(); ++i) list[i] = static_cast<unsigned char>(i);
+	while (first != last) {
+		auto x = static_cast<unsigned char>(*first);
+		auto rank = std::find(list.begin(), list.end(), x);
+		*result = static_cast<char>(rank - list.begin());
+		++result;
+		// a single memmove of the bytes in front of it
+		std::copy_backward(list.begin(), rank, rank + 1);
+		list.front() = x;
+		++first;
+	}
+	return result;
+}
+
+template <typename I, typename O>
+// requires InputIterator<I>
+// requires OutputIterator<O>
+O mtf_decode(I first, I last, O result) {
+	std::array<unsigned char, 256> list;
+	for (std::size_t i = 0; i < list.size(); ++i) list[i] = static_cast<unsigned char>(i);
+	while (first != last) {
+		auto rank = list.begin() + static_cast<unsigned char>(*first);
+		auto x = *rank;
+		*result = static_cast<char>(x);
+		++result;
+		std::copy_backward(list.begin(), rank, rank + 1);
+		list.front() = x;
+		++first;
+	}
+	return result;
+}
+
+constexpr std::size_t mtf_sample_run = 1024;
+constexpr std::size_t mtf_sample_runs = 8;
+
+template <typename I>
+// requires RandomAccessIterator<I>
+double mtf_cost(I first, I last) {
+	// estimated size in bits of the ranks of a block, transforming evenly spaced runs of
+	// it so large blocks are not transformed just to be rejected
+	auto n = static_cast<std::size_t>(last - first);
+	auto& sampled = thread_scratch().sampled;
+	sampled.clear();
+	if (n <= mtf_sample_run * mtf_sample_runs) {
+		sampled.assign(first, last);
+	} else {
+		auto step = n / mtf_sample_runs;
+		for (std::size_t i = 0; i < mtf_sample_runs; ++i) sampled.append(first + i * step, first + i * step + mtf_sample_run);
+	}
+	auto& ranks = thread_scratch().sampled_ranks;
+	ranks.clear();
+	mtf_encode(sampled.begin(), sampled.end(), std::back_inserter(ranks));
+	auto r = count_bytes(ranks.begin(), ranks.end());
+	auto bits = std::max(entropy_cost(r) - header_cost(r), static_cast<double>(ranks.size()));
+	return bits * n / ranks.size() + header_cost(r);
+}
+
+template <typename I>
+// requires RandomAccessIterator<I>
+std::string compress_block(I first, I last, code_table& previous, bool sample = false) {
+	// precondition: first != last
+	// Single symbol, incompressible, all-run and tiny uniform alphabet blocks are
+	// recognised up front and take their fast path. Otherwise picks the cheapest coding
+	// of the block: a fresh table, the table of the last huffman block ({previous}), run
+	// lengths, digrams, move-to-front ranks, tANS, fixed width codes or the raw bytes. A
+	// fresh table is not built when the previous one beats its lower bound, the entropy
+	// or one bit per symbol.
+	auto n = std::distance(first, last);
+	std::string payload;
+	if (std::adjacent_find(first, last, std::not_equal_to<ValueType<I>>{}) == last) {
+		// Huffman coding needs at least two distinct symbols
+		write_bits<8>(payload, static_cast<unsigned char>(*first));
+		return make_block(block_type::single_symbol, n, payload);
+	}
+
+	// with sampling, {seen} counts the sampled bytes only, for the codings that fail
+	// cleanly on a byte the sample missed; {h} also gives the other bytes the count a
+	// table needs to code them
+	auto sampled = sampled_block(first, last, sample);
+	auto seen = sampled ? sample_bytes(first, last) : count_bytes(first, last);
+	auto h = sampled ? with_escapes(seen) : seen;
+	auto bound = block_header_bits + std::max(entropy_cost(h), n + header_cost(h));
+	auto runs = sampled ? sample_runs(first, last) : count_runs(first, last);
+	if (runs * 2 > static_cast<std::size_t>(n) && bound >= block_header_bits + 8 * n) {
+		// incompressible: no table can beat the bytes themselves
+		return make_block(block_type::raw, n, raw_payload(first, last));
+	}
+	std::string rle;
+	if (runs * min_run_length <= static_cast<std::size_t>(n)) {
+		// nothing but long runs, which a table cannot code below one bit per symbol and
+		// only tANS may still beat
+		rle = rle_payload(first, last);
+		if (rle.size() <= ans_cost(seen)) return make_block(block_type::rle, n, rle);
+	}
+	auto packed = packed_width(distinct_symbols(seen)) != 0;
+	if (packed && entropy_cost(seen) >= packed_cost(seen, n)) {
+		// a tiny, near uniform alphabet: not even the entropy beats fixed width codes
+		auto p = packed_payload(first, last, seen);
+		if (!p.empty()) return make_block(block_type::packed, n, p);
+	}
+
+	auto type = block_type::huffman;
+	double cost = bound;
+	auto choose = [&](block_type x, std::string& p) {
+		double bits = block_header_bits + p.size();
+		if (bits >= cost) return;
+		type = x;
+		cost = bits;
+		payload = std::move(p);
+	};
+
+	auto reuse = previous.empty() ? std::numeric_limits<std::size_t>::max() : reuse_cost(h, previous);
+	code_table fresh;
+	if (reuse > cost) {
+		payload = build_table(h, fresh);
+		cost = reuse_cost(h, fresh) + payload.size();
+	}
+	if (reuse <= cost) {
+		type = block_type::repeat_table;
+		cost = reuse;
+	}
+	if (runs * 2 <= static_cast<std::size_t>(n)) {
+		if (rle.empty()) rle = rle_payload(first, last);
+		choose(block_type::rle, rle);
+	}
+	if (*std::max_element(h.begin(), h.end()) * 2 > static_cast<std::size_t>(n)) {
+		// only a byte with more than half the block leaves much below one bit per symbol
+		auto p = digram_payload(first, last);
+		if (!p.empty()) choose(block_type::digram, p);
+	}
+	if (block_header_bits + mtf_cost(first, last) < cost) {
+		auto& ranks = thread_scratch().ranks;
+		ranks.clear();
+		mtf_encode(first, last, std::back_inserter(ranks));
+		code_table codes;
+		auto p = build_table(count_bytes(ranks.begin(), ranks.end()), codes);
+		p += encode_with(codes, ranks.begin(), ranks.end());
+		choose(block_type::mtf, p);
+	}
+	if (block_header_bits + ans_cost(seen) < cost) {
+		auto p = ans_payload(first, last, seen, thread_scratch().ans);
+		if (!p.empty()) choose(block_type::tans, p);
+	}
+	if (packed && block_header_bits + packed_cost(seen, n) < cost) {
+		auto p = packed_payload(first, last, seen);
+		if (!p.empty()) choose(block_type::packed, p);
+	}
+	if (block_header_bits + 8 * n < cost) {
+		auto p = raw_payload(first, last);
+		choose(block_type::raw, p);
+	}
+
+	switch (type) {
+	case block_type::huffman:
+		payload += encode_with(fresh, first, last);
+		previous = std::move(fresh);
+		break;
+	case block_type::repeat_table:
+		payload = encode_with(previous, first, last);
+		break;
+	default:
+		break;
+	}
+	return make_block(type, n, payload);
+}
+
+template <typename I, typename O>
+// requires RandomAccessIterator<I>
+// requires OutputIterator<O>
+O decompress_block(I& first, O result, const std::vector<huffman_decoder<char>>& shared, huffman_decoder<char>& previous) {
+	auto type = static_cast<block_type>(read_bits<block_type_bits>(first));
+	auto n = read_bits<32>(first);
+	auto size = read_bits<32>(first);
+	auto last = first + size;
+
+	switch (type) {
+	case block_type::huffman:
+		first = previous.read_canonical_table(first, byte_codec{});
+		result = decode_with(previous, first, n, result);
+		break;
+	case block_type::single_symbol:
+		result = std::fill_n(result, n, static_cast<char>(read_bits<8>(first)));
+		break;
+	case block_type::shared_table: {
+		const auto& decoder = shared[read_bits<4>(first)];
+		result = decode_with(decoder, first, n, result);
+		break;
+	}
+	case block_type::repeat_table:
+		result = decode_with(previous, first, n, result);
+		break;
+	case block_type::rle:
+		result = rle_decode(first, n, result);
+		break;
+	case block_type::digram:
+		result = digram_decode(first, n, result);
+		break;
+	case block_type::tans:
+		result = ans_decode(first, n, result, thread_scratch().ans);
+		break;
+	case block_type::packed:
+		result = packed_decode(first, n, result);
+		break;
+	case block_type::mtf: {
+		auto& decoder = thread_scratch().symbols;
+		auto& ranks = thread_scratch().ranks;
+		first = decoder.read_canonical_table(first, byte_codec{});
+		ranks.clear();
+		decode_with(decoder, first, n, std::back_inserter(ranks));
+		result = mtf_decode(ranks.begin(), ranks.end(), result);
+		break;
+	}
+	case block_type::raw:
+		while (n) {
+			--n;
+			*result = static_cast<char>(read_bits<8>(first));
+			++result;
+		}
+		break;
+	}
+	first = last;
+	return result;
+}
+
+using block_bounds = std::vector<std::pair<std::size_t, std::size_t>>;
+
+inline block_bounds fixed_blocks(std::size_t size, std::size_t block_size) {
+	block_bounds blocks;
+	for (std::size_t i = 0; i < size; i += block_size) {
+		blocks.emplace_back(i, std::min(i + block_size, size));
+	}
+	return blocks;
+}
+
+inline std::string compress_blocks(const std::string& input, const block_bounds& blocks, std::size_t shared_tables = 0, bool sample = false) {
+	// With {shared_tables} != 0 the blocks are clustered by histogram into at most that
+	// many tables (up to {max_shared_tables}), written once in the frame header. With
+	// {sample} set the histograms of very large blocks are estimated from a sample.
+	std::vector<byte_histogram> histograms;
+	std::vector<std::size_t> shared(blocks.size(), max_shared_tables);
+	if (shared_tables) {
+		std::vector<std::size_t> clustered;
+		for (std::size_t i = 0; i < blocks.size(); ++i) {
+			auto h = block_histogram(input.begin() + blocks[i].first, input.begin() + blocks[i].second, sample);
+			if (distinct_symbols(h) < 2) continue;
+			clustered.push_back(i);
+			histograms.push_back(h);
+		}
+		auto clusters = cluster_histograms(histograms, std::min(shared_tables, max_shared_tables));
+		std::vector<byte_histogram> tables;
+		for (std::size_t i = 0; i < clustered.size(); ++i) {
+			shared[clustered[i]] = clusters[i];
+			if (clusters[i] == tables.size()) tables.emplace_back();
+			tables[clusters[i]] += histograms[i];
+		}
+		histograms = tables;
+	}
+
+	std::string result;
+	write_bits<32>(result, blocks.size());
+	write_bits<5>(result, histograms.size());
+	std::vector<code_table> codes;
+	for (const auto& x : build_tables(histograms, codes)) result += x;
+
+	code_table previous;
+	for (std::size_t i = 0; i < blocks.size(); ++i) {
+		auto first = input.begin() + blocks[i].first;
+		auto last = input.begin() + blocks[i].second;
+		if (shared[i] == max_shared_tables) {
+			result += compress_block(first, last, previous, sample);
+		} else {
+			std::string payload;
+			write_bits<4>(payload, shared[i]);
+			payload += encode_with(codes[shared[i]], first, last);
+			result += make_block(block_type::shared_table, last - first, payload);
+		}
+	}
+	return result;
+}
+
+inline std::string compress_blocks(const std::string& input, std::size_t block_size = default_block_size, std::size_t shared_tables = 0, bool sample = false) {
+	return compress_blocks(input, fixed_blocks(input.size(), block_size), shared_tables, sample);
+}
+
+inline std::string decompress_blocks(const std::string& input) {
+	auto first = input.begin();
+	auto n = read_bits<32>(first);
+	auto& shared = thread_scratch().shared;
+	shared.resize(read_bits<5>(first));
+	for (auto& decoder : shared) first = decoder.read_canonical_table(first, byte_codec{});
+
+	auto& previous = thread_scratch().previous;
+	std::string result;
+	while (n) {
+		--n;
+		decompress_block(first, std::back_inserter(result), shared, previous);
+	}
+	return result;
+}
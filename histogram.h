@@ -0,0 +1,219 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <vector>
+
+using byte_histogram = std::array<std::size_t, 256>;
+
+template <typename I>
+// requires InputIterator<I>
+byte_histogram count_bytes(I first, I last) {
+	byte_histogram h{};
+	while (first != last) {
+		++h[static_cast<unsigned char>(*first)];
+		++first;
+	}
+	return h;
+}
+
+constexpr std::size_t sample_run = 64;
+constexpr std::size_t sample_period = 16;
+
+template <typename I, typename F>
+// requires RandomAccessIterator<I>
+void for_each_sample(I first, I last, F f) {
+	// Calls f(x, y) for one run [x, y) of {sample_run} bytes in every stratum of
+	// {sample_period} runs. The run of stratum k is the top bits of the Weyl sequence
+	// k * 2^64 / phi, which is equidistributed over every arithmetic progression of
+	// strata, so data with any period is sampled at all its phases.
+	static_assert(sample_period == 16, "the run is taken from the top 4 bits");
+	auto n = static_cast<std::size_t>(last - first);
+	auto stratum = sample_run * sample_period;
+	for (std::size_t i = 0, k = 0; i < n; i += stratum, ++k) {
+		auto x = std::min(n, i + static_cast<std::size_t>((k * 0x9e3779b97f4a7c15ull) >> 60) * sample_run);
+		auto y = std::min(n, x + sample_run);
+		if (x != y) f(first + x, first + y);
+	}
+}
+
+template <typename I>
+// requires RandomAccessIterator<I>
+byte_histogram sample_bytes(I first, I last) {
+	// estimates the histogram from the runs of for_each_sample; a byte value that was not
+	// sampled has no count, see with_escapes
+	byte_histogram h{};
+	for_each_sample(first, last, [&h](I x, I y) {
+		for (; x != y; ++x) ++h[static_cast<unsigned char>(*x)];
+	});
+	for (auto& x : h) x *= sample_period;
+	return h;
+}
+
+inline byte_histogram with_escapes(byte_histogram h) {
+	// gives every byte value without a count a count of one, so a table built from a
+	// sampled histogram can code any byte of the range without another pass over it
+	for (auto& x : h) x = x ? x : 1;
+	return h;
+}
+
+inline byte_histogram& operator+=(byte_histogram& x, const byte_histogram& y) {
+	for (std::size_t i = 0; i < x.size(); ++i) x[i] += y[i];
+	return x;
+}
+
+inline std::size_t distinct_symbols(const byte_histogram& h) {
+	std::size_t n = 0;
+	for (auto x : h) n += x != 0;
+	return n;
+}
+
+inline double header_cost(const byte_histogram& h) {
+	// longest length and count width, a count per length and 8 bits per symbol, taking
+	// the longest code as twice the depth of a balanced tree
+	auto n = distinct_symbols(h);
+	if (!n) return 0;
+	std::size_t width = 0;
+	while (n >> width) ++width;
+	return 6 + 5 + 2 * width * width + 8 * n;
+}
+
+inline double entropy_cost(const byte_histogram& h) {
+	// estimated size in bits of a block with this histogram including its header
+	std::size_t total = 0;
+	for (auto x : h) total += x;
+	double bits = 0;
+	for (auto x : h) {
+		if (x) bits += x * std::log2(static_cast<double>(total) / x);
+	}
+	return bits + header_cost(h);
+}
+
+inline std::vector<std::size_t> merge_histograms(std::vector<byte_histogram> clusters, std::size_t max_clusters) {
+	// Greedily merges the pair of clusters whose union costs the least extra, until no
+	// merge saves bits and at most {max_clusters} remain. Returns the cluster of each
+	// histogram, numbered from 0 in order of first appearance. Every merge rescans all
+	// pairs, so this is cubic in the number of histograms.
+	auto n = clusters.size();
+	std::vector<double> costs(n);
+	std::vector<bool> alive(n, true);
+	std::vector<std::size_t> parent(n);
+	for (std::size_t i = 0; i < n; ++i) {
+		costs[i] = entropy_cost(clusters[i]);
+		parent[i] = i;
+	}
+
+	auto merge_cost = [&](std::size_t i, std::size_t j) {
+		auto h = clusters[i];
+		h += clusters[j];
+		return entropy_cost(h) - costs[i] - costs[j];
+	};
+
+	std::vector<std::vector<double>> deltas(n, std::vector<double>(n));
+	for (std::size_t i = 0; i < n; ++i) {
+		for (std::size_t j = i + 1; j < n; ++j) deltas[i][j] = merge_cost(i, j);
+	}
+
+	auto k = n;
+	while (k > 1) {
+		std::size_t x = 0, y = 0;
+		auto best = std::numeric_limits<double>::infinity();
+		for (std::size_t i = 0; i < n; ++i) {
+			if (!alive[i]) continue;
+			for (std::size_t j = i + 1; j < n; ++j) {
+				if (alive[j] && deltas[i][j] < best) {
+					best = deltas[i][j];
+					x = i;
+					y = j;
+				}
+			}
+		}
+		if (k <= max_clusters && best >= 0) break;
+
+		clusters[x] += clusters[y];
+		costs[x] += costs[y] + best;
+		alive[y] = false;
+		parent[y] = x;
+		--k;
+		for (std::size_t i = 0; i < n; ++i) {
+			if (!alive[i] || i == x) continue;
+			if (i < x) deltas[i][x] = merge_cost(i, x);
+			else deltas[x][i] = merge_cost(x, i);
+		}
+	}
+
+	std::vector<std::size_t> result(n);
+	std::vector<std::size_t> ids(n, n);
+	std::size_t next_id = 0;
+	for (std::size_t i = 0; i < n; ++i) {
+		auto root = i;
+		while (parent[root] != root) root = parent[root];
+		if (ids[root] == n) ids[root] = next_id++;
+		result[i] = ids[root];
+	}
+	return result;
+}
+
+constexpr std::size_t max_cluster_seeds = 256;
+
+inline std::array<double, 256> code_bits(const byte_histogram& h) {
+	// the bits per byte of a code for {h}, smoothed so every byte can be coded
+	std::size_t total = 256;
+	for (auto x : h) total += x;
+	std::array<double, 256> bits;
+	for (std::size_t i = 0; i < h.size(); ++i) bits[i] = std::log2(static_cast<double>(total) / (h[i] + 1));
+	return bits;
+}
+
+inline double cross_cost(const byte_histogram& h, const std::array<double, 256>& bits) {
+	double result = 0;
+	for (std::size_t i = 0; i < h.size(); ++i) result += h[i] * bits[i];
+	return result;
+}
+
+inline std::vector<std::size_t> cluster_histograms(const std::vector<byte_histogram>& histograms, std::size_t max_clusters) {
+	// Returns the cluster of each histogram, numbered from 0 in order of first appearance.
+	// Up to {max_cluster_seeds} histograms are merged directly. Beyond that, seeds are
+	// picked farthest point first: the next seed is the histogram that the code of its
+	// nearest seed wastes the most bits on, until none wastes more than a header. Every
+	// histogram joins its nearest seed and the seed clusters are then merged, so the
+	// work grows linearly with the number of histograms.
+	auto n = histograms.size();
+	if (n <= max_cluster_seeds) return merge_histograms(histograms, max_clusters);
+
+	std::vector<double> own(n), waste(n, std::numeric_limits<double>::infinity());
+	std::vector<std::size_t> nearest(n);
+	for (std::size_t i = 0; i < n; ++i) own[i] = cross_cost(histograms[i], code_bits(histograms[i]));
+
+	std::vector<byte_histogram> seeds;
+	std::size_t next = 0;
+	while (seeds.size() < max_cluster_seeds) {
+		auto bits = code_bits(histograms[next]);
+		for (std::size_t i = 0; i < n; ++i) {
+			auto x = cross_cost(histograms[i], bits) - own[i];
+			if (x < waste[i]) {
+				waste[i] = x;
+				nearest[i] = seeds.size();
+			}
+		}
+		seeds.emplace_back();
+		next = std::max_element(waste.begin(), waste.end()) - waste.begin();
+		if (waste[next] <= header_cost(histograms[next])) break;
+	}
+
+	for (std::size_t i = 0; i < n; ++i) seeds[nearest[i]] += histograms[i];
+	auto merged = merge_histograms(seeds, max_clusters);
+
+	std::vector<std::size_t> result(n);
+	std::vector<std::size_t> ids(seeds.size(), n);
+	std::size_t next_id = 0;
+	for (std::size_t i = 0; i < n; ++i) {
+		auto& id = ids[merged[nearest[i]]];
+		if (id == n) id = next_id++;
+		result[i] = id;
+	}
+	return result;
+}
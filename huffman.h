@@ -1,16 +1,32 @@
 #pragma once
 
-#include <bitset>
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <functional>
 #include <iterator>
+#include <memory>
+#include <stdexcept>
 #include <string>
-#include <unordered_map>
 #include <utility>
 #include <vector>
+#include "bits.h"
 
 template <typename I>
 using ValueType = typename std::iterator_traits<I>::value_type;
 
+// Every container of the encoder and decoder, and the code strings they pass around,
+// allocate through the Allocator template parameter rebound to their element type, so
+// a std::pmr::polymorphic_allocator over a monotonic arena can serve a whole message.
+
+template <typename Allocator, typename T>
+using Rebind = typename std::allocator_traits<Allocator>::template rebind_alloc<T>;
+
+template <typename Allocator>
+using code_string = std::basic_string<char, std::char_traits<char>, Rebind<Allocator, char>>;
+
 template <typename I, typename Compare>
 // requires ForwardIterator<I>
 // requires BinaryPredicate<Compare>
@@ -21,17 +37,18 @@ I next_node(I& f0, I l0, I& f1, I l1, Compare cmp) {
 	return f0++;
 }
 
-template <typename I, typename Compare, typename F>
+template <typename I, typename Compare, typename F, typename Allocator = std::allocator<char>>
 // requires ForwardIterator<I>
 // requires TotalOrdering<Compare, ValueType<I>>
-// requires UnaryFunction<F, std::pair<I, std::string>>
-void generate_codes(I f0, I l0, I f1, I l1, Compare cmp, F f) {
-	std::vector<std::pair<I, std::string>> prefixes;
+// requires UnaryFunction<F, std::pair<I, code_string<Allocator>>>
+void generate_codes(I f0, I l0, I f1, I l1, Compare cmp, F f, const Allocator& alloc = Allocator{}) {
+	using prefix = std::pair<I, code_string<Allocator>>;
+	std::vector<prefix, Rebind<Allocator, prefix>> prefixes{Rebind<Allocator, prefix>{alloc}};
 	auto n = l0 - f1;
 	prefixes.reserve(n);
 	
 	// Add the 'root' element
-	prefixes.emplace_back(f1, std::string{});
+	prefixes.emplace_back(f1, code_string<Allocator>{Rebind<Allocator, char>{alloc}});
 	++f1;
 	auto current = prefixes.begin();
 
@@ -51,46 +68,238 @@ void generate_codes(I f0, I l0, I f1, I l1, Compare cmp, F f) {
 	}
 }
 
-template <typename T, typename Compare, typename Op>
+struct packed_code {
+	std::uint64_t bits; // the code in the low {length} bits, most significant bit first
+	unsigned length;
+};
+
+inline void append_code(std::string& result, packed_code x) {
+	// expands the code a byte at a time through a table of the eight characters of every byte
+	static const auto expanded = [] {
+		std::array<std::array<char, 8>, 256> table;
+		for (std::size_t i = 0; i < table.size(); ++i) {
+			for (std::size_t j = 0; j < 8; ++j) table[i][j] = (i >> (7 - j)) & 1 ? '1' : '0';
+		}
+		return table;
+	}();
+	if (!x.length) return;
+	char bits[64];
+	auto v = x.bits << (64 - x.length);
+	for (unsigned i = 0; i < x.length; i += 8, v <<= 8) std::memcpy(bits + i, expanded[v >> 56].data(), 8);
+	result.append(bits, x.length);
+}
+
+template <typename T, typename Hash = std::hash<T>, typename KeyEqual = std::equal_to<T>, typename Allocator = std::allocator<T>>
+// requires Regular<T>
+// requires HashFunction<Hash, T>
+// requires EquivalenceRelation<KeyEqual, T>
+class perfect_hash_codes {
+	// Static hash and displace table from the symbols of a code table to their packed
+	// codes: symbols are hashed into buckets, and every bucket, largest first, searches
+	// for a seed that sends all of its symbols to free slots. A lookup is then two
+	// hashes, one probe and one comparison. Symbols whose hashes cannot be separated
+	// within a bounded search go to a short overflow list.
+private:
+	static constexpr unsigned max_seed = 1 << 12;
+
+	template <typename U>
+	using vector = std::vector<U, Rebind<Allocator, U>>;
+
+	vector<std::pair<T, packed_code>> entries;
+	vector<unsigned> seeds;
+	vector<int> slots; // index into entries, -1 when free
+	vector<std::size_t> overflow;
+	Hash hash;
+	KeyEqual equal;
+
+	unsigned bucket_shift = 63;
+	unsigned slot_shift = 63;
+
+	// multiplicative hashing, the top bits of the product are the well mixed ones
+	std::size_t bucket(std::uint64_t h) const { return (h * 0xc4ceb9fe1a85ec53ull) >> bucket_shift; }
+
+	std::size_t slot(std::uint64_t h, unsigned seed) const {
+		return ((h ^ (seed * 0xff51afd7ed558ccdull)) * 0x9e3779b97f4a7c15ull) >> slot_shift;
+	}
+
+public:
+	perfect_hash_codes(const Hash& hash = Hash{}, const KeyEqual& equal = KeyEqual{}, const Allocator& alloc = Allocator{})
+		: entries(alloc), seeds(alloc), slots(alloc), overflow(alloc), hash{hash}, equal{equal} { }
+
+	explicit perfect_hash_codes(const Allocator& alloc) : perfect_hash_codes(Hash{}, KeyEqual{}, alloc) { }
+
+	void insert(const std::pair<T, std::string>& x) {
+		insert<std::string>(x);
+	}
+
+	template <typename String>
+	// requires Sequence<String, char>
+	void insert(const std::pair<T, String>& x) {
+		// precondition: x.second.size() <= 64 && the table is not sealed
+		std::uint64_t bits = 0;
+		for (auto bit : x.second) bits = (bits << 1) | (bit == '1');
+		entries.emplace_back(x.first, packed_code{bits, static_cast<unsigned>(x.second.size())});
+	}
+
+	void seal() {
+		// builds the hash over the inserted symbols, afterwards only lookups are allowed
+		unsigned log = 4;
+		while ((std::size_t{1} << log) < 2 * entries.size()) ++log;
+		slots.assign(std::size_t{1} << log, -1);
+		seeds.assign(std::size_t{1} << (log - 3), 0);
+		slot_shift = 64 - log;
+		bucket_shift = 64 - (log - 3);
+		overflow.clear();
+
+		auto alloc = entries.get_allocator();
+		vector<vector<std::size_t>> buckets(seeds.size(), vector<std::size_t>(alloc), alloc);
+		vector<std::uint64_t> hashes(entries.size(), 0, alloc);
+		for (std::size_t i = 0; i < entries.size(); ++i) {
+			hashes[i] = hash(entries[i].first);
+			buckets[bucket(hashes[i])].push_back(i);
+		}
+		vector<std::size_t> order(buckets.size(), 0, alloc);
+		for (std::size_t i = 0; i < order.size(); ++i) order[i] = i;
+		std::stable_sort(order.begin(), order.end(), [&buckets](std::size_t x, std::size_t y) {
+			return buckets[x].size() > buckets[y].size();
+		});
+
+		vector<std::size_t> taken(alloc);
+		for (auto b : order) {
+			const auto& keys = buckets[b];
+			if (keys.empty()) break;
+			unsigned seed = 0;
+			for (; seed < max_seed; ++seed) {
+				taken.clear();
+				auto free = true;
+				for (auto i : keys) {
+					auto s = slot(hashes[i], seed);
+					if (slots[s] != -1 || std::find(taken.begin(), taken.end(), s) != taken.end()) {
+						free = false;
+						break;
+					}
+					taken.push_back(s);
+				}
+				if (free) break;
+			}
+			if (seed == max_seed) {
+				overflow.insert(overflow.end(), keys.begin(), keys.end());
+				continue;
+			}
+			seeds[b] = seed;
+			for (std::size_t j = 0; j < keys.size(); ++j) slots[taken[j]] = static_cast<int>(keys[j]);
+		}
+	}
+
+	const packed_code& operator[](const T& x) const {
+		// throws std::out_of_range when {x} was not inserted, as unordered_map::at does
+		// precondition: the table is sealed
+		std::uint64_t h = hash(x);
+		auto i = slots[slot(h, seeds[bucket(h)])];
+		if (i != -1 && equal(entries[i].first, x)) return entries[i].second;
+		for (auto j : overflow) {
+			if (equal(entries[j].first, x)) return entries[j].second;
+		}
+		throw std::out_of_range("perfect_hash_codes: symbol has no code");
+	}
+};
+
+template <typename T>
+// requires Integral<T>
+class dense_codes {
+	// The packed code of every symbol of 0, 1, ..., n - 1 indexed by the symbol, for
+	// dense ids where a hash would only add work: nothing is sealed and a lookup is an
+	// index.
+private:
+	std::vector<packed_code> codes;
+public:
+	explicit dense_codes(std::size_t n) : codes(n, packed_code{0, 0}) { }
+
+	template <typename String>
+	// requires Sequence<String, char>
+	void insert(const std::pair<T, String>& x) {
+		// precondition: x.first < n && x.second.size() <= 64
+		std::uint64_t bits = 0;
+		for (auto bit : x.second) bits = (bits << 1) | (bit == '1');
+		codes[x.first] = packed_code{bits, static_cast<unsigned>(x.second.size())};
+	}
+
+	const packed_code& operator[](T x) const {
+		// precondition: x < n
+		return codes[x];
+	}
+};
+
+template <typename Compare>
+// requires StrictWeakOrdering<Compare>
+struct complement {
+	// !cmp(x, y), as std::not2 without its need for argument typedefs
+	Compare cmp;
+
+	template <typename T>
+	bool operator()(const T& x, const T& y) const {
+		return !cmp(x, y);
+	}
+};
+
+// the header of a huffman_encoder starts with its node count, 2n - 1 for n symbols, in
+// 16 bits, so a tree header holds at most this many symbols
+constexpr std::size_t max_header_symbols = 1 << 15;
+
+template <typename T, typename Compare, typename Op, typename Allocator = std::allocator<T>>
 // requires Regular<T>
 // requires TotalOrdering<Compare, T>
 // requires MonoidOperation<Op, T>
 class huffman_encoder {
 private:
-	std::vector<T> nodes;
+	std::vector<T, Allocator> nodes;
 	Compare cmp;
 	Op op;
 public:
-	huffman_encoder(std::vector<T> nodes, const Compare& cmp, const Op& op) : nodes{std::move(nodes)}, cmp{cmp}, op{op} { 
+	huffman_encoder(std::vector<T, Allocator> nodes, const Compare& cmp, const Op& op) : nodes{std::move(nodes)}, cmp{cmp}, op{op} { 
 		// precondition: is_sorted(nodes.begin(), nodes.end(), cmp)
 	}
 
-	template <typename I, typename F, typename BinaryConverter>
-	std::string operator()(I first, I last, F f, BinaryConverter converter) {
-		using reverse_iterator = typename std::vector<T>::reverse_iterator;
-		auto lnodes = nodes.size();
-		build_huffman_array();
-		
-		std::string result = header(converter);
-		std::unordered_map<ValueType<I>, std::string> st;
-		auto st_op = [&st, f](const std::pair<reverse_iterator, std::string>& x) {
-			st.insert(std::make_pair(f(*x.first), x.second));
-		};
-
-		generate_codes(nodes.rend() - lnodes, nodes.rend(), nodes.rbegin(), nodes.rend() - lnodes, std::not2(cmp), st_op);
+	template <typename I, typename F, typename SymbolCodec>
+	std::string operator()(I first, I last, F f, SymbolCodec codec) {
+		using U = ValueType<I>;
+		perfect_hash_codes<U, std::hash<U>, std::equal_to<U>, Rebind<Allocator, U>> st{nodes.get_allocator()};
+		std::string result = build(f, codec, st);
+		st.seal();
 		
 		// encode the input with generated codes
 		while (first != last) {
-			result += st[*first];
+			append_code(result, st[*first]);
 			++first;
 		}
 
 		return result;
 	}
 
+	template <typename F, typename SymbolCodec, typename Map>
+	// requires UnaryFunction<F, T>
+	// requires SymbolCodec<SymbolCodec, Codomain<F>>
+	// requires AssociativeContainer<Map>
+	std::string build(F f, SymbolCodec codec, Map& st) {
+		// builds the huffman array, fills {st} with the code of every symbol and returns the
+		// header; the codes are code_string<Allocator>, std::string for the default allocator
+		using reverse_iterator = typename std::vector<T, Allocator>::reverse_iterator;
+		auto lnodes = nodes.size();
+		build_huffman_array();
+		
+		std::string result = header(f, codec);
+		auto st_op = [&st, f](const std::pair<reverse_iterator, code_string<Allocator>>& x) {
+			st.insert(std::make_pair(f(*x.first), x.second));
+		};
+
+		generate_codes(nodes.rend() - lnodes, nodes.rend(), nodes.rbegin(), nodes.rend() - lnodes, complement<Compare>{cmp}, st_op, nodes.get_allocator());
+		return result;
+	}
+
 private:
 	void build_huffman_array() {
 		auto size = nodes.size();
+		if (size < 2) return; // a single symbol is the root and gets the empty code
 		auto n = size * 2 - 1; // huffman tree with {size} nodes has {size} * 2 - 1 total nodes
 		nodes.reserve(n); // important, we don't want to invalidate iterators adding elements later
 
@@ -108,10 +317,11 @@ private:
 		}
 	}
 
-	template <typename BinaryConverter>
-	std::string header(BinaryConverter converter) {
-		std::bitset<16> size{nodes.size()};
-		std::string result = size.to_string();
+	template <typename F, typename SymbolCodec>
+	std::string header(F f, SymbolCodec& codec) {
+		// precondition: nodes.size() < 2 * max_header_symbols
+		std::string result;
+		write_bits<16>(result, nodes.size());
 
 		auto f0 = nodes.begin();
 		auto l0 = nodes.begin() + nodes.size() / 2 + 1; // end of leaf nodes
@@ -122,7 +332,7 @@ private:
 			// is leaf node
 			if (x < l0) {
 				result += '1';
-				result += converter(*x);
+				codec.write(result, f(*x));
 			} else {
 				result += '0';
 			}
@@ -131,69 +341,218 @@ private:
 	}
 };
 
-template <typename T>
+// Canonical tables: the code lengths are computed in place on the weights sorted in
+// increasing order (Moffat and Katajainen), and codes are assigned in order of length.
+// The header is the longest length, the number of codes of every length and the
+// symbols in code order, so no tree has to be built or sent.
+
+template <typename I, typename F>
+// requires RandomAccessIterator<I>
+// requires UnaryFunction<F, ValueType<I>&> returning std::size_t&
+void code_lengths_in_place(I first, I last, F weight) {
+	// replaces the weight of every element by the length of its code, which leaves the
+	// lengths in non-increasing order
+	// precondition: the weights are sorted in increasing order
+	auto n = static_cast<std::size_t>(last - first);
+	if (n == 0) return;
+	if (n == 1) {
+		weight(first[0]) = 0;
+		return;
+	}
+
+	// first pass, left to right: merge the two smallest of leaves and internal nodes,
+	// leaving in every consumed internal node the index of its parent
+	weight(first[0]) += weight(first[1]);
+	std::size_t root = 0;
+	std::size_t leaf = 2;
+	for (std::size_t next = 1; next < n - 1; ++next) {
+		if (leaf >= n || weight(first[root]) < weight(first[leaf])) {
+			weight(first[next]) = weight(first[root]);
+			weight(first[root++]) = next;
+		} else {
+			weight(first[next]) = weight(first[leaf++]);
+		}
+		if (leaf >= n || (root < next && weight(first[root]) < weight(first[leaf]))) {
+			weight(first[next]) += weight(first[root]);
+			weight(first[root++]) = next;
+		} else {
+			weight(first[next]) += weight(first[leaf++]);
+		}
+	}
+
+	// second pass, right to left: depths of the internal nodes
+	weight(first[n - 2]) = 0;
+	for (std::size_t next = n - 2; next--;) weight(first[next]) = weight(first[weight(first[next])]) + 1;
+
+	// third pass, right to left: depths of the leaves
+	std::size_t available = 1;
+	std::size_t used = 0;
+	std::size_t depth = 0;
+	auto internal = static_cast<std::ptrdiff_t>(n) - 2;
+	auto next = n;
+	while (available) {
+		while (internal >= 0 && weight(first[internal]) == depth) {
+			++used;
+			--internal;
+		}
+		while (available > used) {
+			weight(first[--next]) = depth;
+			--available;
+		}
+		available = 2 * used;
+		++depth;
+		used = 0;
+	}
+}
+
+template <typename I, typename F, typename SymbolCodec, typename Map>
+// requires BidirectionalIterator<I>
+// requires UnaryFunction<F, ValueType<I>>
+// requires SymbolCodec<SymbolCodec, Codomain<F>>
+// requires AssociativeContainer<Map>
+std::string canonical_table(I first, I last, F f, SymbolCodec codec, Map& st) {
+	// fills {st} with the canonical code of every (length, symbol) pair of [first, last),
+	// taking the symbol through {f}, and returns the header
+	// precondition: first != last, the lengths are in non-increasing order and below 64
+	auto longest = first->first;
+	std::array<std::size_t, 64> counts{};
+	for (auto x = first; x != last; ++x) ++counts[x->first];
+	std::size_t width = 0;
+	for (std::size_t i = 1; i <= longest; ++i) {
+		while (counts[i] >> width) ++width;
+	}
+
+	std::string result;
+	result.reserve(6 + 5 + longest * width + 8 * static_cast<std::size_t>(std::distance(first, last)));
+	write_bits<6>(result, longest);
+	write_bits<5>(result, width);
+	for (std::size_t i = 1; i <= longest; ++i) write_bits(result, counts[i], width);
+
+	std::uint64_t code = 0;
+	std::size_t length = std::prev(last)->first;
+	while (first != last) {
+		--last;
+		code <<= last->first - length;
+		length = last->first;
+		codec.write(result, f(*last));
+		std::string bits;
+		write_bits(bits, code, length);
+		st.insert(std::make_pair(f(*last), std::move(bits)));
+		++code;
+	}
+	return result;
+}
+
+template <typename T, typename Allocator = std::allocator<T>>
 // requires Regular<T>
 class huffman_decoder {
 private:
-	std::vector<std::pair<int, T>> nodes;
+	template <typename U>
+	using vector = std::vector<U, Rebind<Allocator, U>>;
+
+	vector<std::pair<int, T>> nodes;
+	// binary trie over the codes, a negative entry -(i + 1) is a leaf holding symbols[i]
+	vector<std::array<int, 2>> table;
+	vector<T> symbols;
 public:
-	template <typename O, typename BinaryConverter>
+	explicit huffman_decoder(const Allocator& alloc = Allocator{}) : nodes(alloc), table(alloc), symbols(alloc) { }
+
+	template <typename O, typename SymbolCodec>
 	// requires OutputIterator<I>
-	O operator()(const std::string& input, O result, BinaryConverter converter) {
-		using reverse_iterator = typename std::vector<std::pair<int, T>>::reverse_iterator;
-		auto current = read_header(input, converter);	
+	O operator()(const std::string& input, O result, SymbolCodec codec) {
+		auto current = read_table(input.begin(), codec);
+		while (current != input.end()) {
+			*result = decode(current);
+			++result;
+		}
+		return result;
+	}
+
+	template <typename I, typename SymbolCodec>
+	// requires RandomAccessIterator<I>
+	// requires SymbolCodec<SymbolCodec, T>
+	I read_table(I first, SymbolCodec codec) {
+		using reverse_iterator = typename vector<std::pair<int, T>>::reverse_iterator;
+		first = read_header(first, codec);
 		auto lnodes = nodes.size() / 2 + 1;
-		// keep hold of the prefixes for the leaf nodes
-		std::vector<std::pair<reverse_iterator, std::string>> prefixes;
-		prefixes.reserve(lnodes);
-		auto prefix_op = [&prefixes](const std::pair<reverse_iterator, std::string>& x) {
-			prefixes.push_back(x);
+		table.assign(1, {{0, 0}});
+		symbols.clear();
+		symbols.reserve(lnodes);
+		auto table_op = [this](const std::pair<reverse_iterator, code_string<Allocator>>& x) {
+			std::uint64_t bits = 0;
+			for (auto bit : x.second) bits = (bits << 1) | (bit == '1');
+			add_code({bits, static_cast<unsigned>(x.second.size())}, x.first->second);
 		};
-
-		std::sort(prefixes.begin(), prefixes.end(), [](const std::pair<reverse_iterator, std::string>& x, const std::pair<reverse_iterator, std::string>& y) {
-			return x.second.size() < y.second.size();
-		});
-			
+		
 		auto cmp = [](const std::pair<int, T>& x, const std::pair<int, T>& y) { return !(x.first < y.first); };
-		generate_codes(nodes.rend() - lnodes, nodes.rend(), nodes.rbegin(), nodes.rend() - lnodes, cmp, prefix_op);
+		generate_codes(nodes.rend() - lnodes, nodes.rend(), nodes.rbegin(), nodes.rend() - lnodes, cmp, table_op, symbols.get_allocator());
+		return first;
+	}
 
-		std::string bits_read;
-		while (current != input.end()) {
-			// find the matching prefix
-			for (const auto& prefix : prefixes) {
-				// read bits until we match the current prefix size
-				while (prefix.second.size() > bits_read.size()) {
-					bits_read.push_back(*current);
-					++current;
-				}
+	template <typename I, typename SymbolCodec>
+	// requires RandomAccessIterator<I>
+	// requires SymbolCodec<SymbolCodec, T>
+	I read_canonical_table(I first, SymbolCodec codec) {
+		// reads a header written by canonical_table and returns the iterator after it
+		std::size_t longest = read_bits<6>(first);
+		std::size_t width = read_bits<5>(first);
+		std::array<std::size_t, 64> counts{};
+		counts[0] = longest == 0; // a lone symbol has the empty code
+		for (std::size_t i = 1; i <= longest; ++i) counts[i] = read_bits(first, width);
 
-				if (bits_read == prefix.second) {
-					*result = prefix.first->second;
-					++result;
-					bits_read.clear(); // make sure to reset the bits read
-					break;
-				}
+		table.assign(1, {{0, 0}});
+		symbols.clear();
+		std::uint64_t code = 0;
+		for (std::size_t length = 0; length <= longest; ++length) {
+			for (std::size_t i = 0; i < counts[length]; ++i) {
+				add_code({code, static_cast<unsigned>(length)}, codec.read(first));
+				++code;
 			}
+			code <<= 1;
+		}
+		return first;
+	}
+
+	template <typename I>
+	// requires InputIterator<I>
+	T decode(I& first) const {
+		if (symbols.size() == 1) return symbols.front(); // the only symbol has the empty code
+		int i = 0;
+		while (true) {
+			i = table[i][*first == '1'];
+			++first;
+			if (i < 0) return symbols[-i - 1];
 		}
-		return result;
 	}
 
 private:
-	template <typename BinaryConverter>
-	typename std::string::const_iterator read_header(const std::string& input, BinaryConverter converter) {
-		std::bitset<16> size{input.substr(0, 16)};
-		nodes = std::vector<std::pair<int, T>>(size.to_ulong());
+	void add_code(packed_code code, const T& x) {
+		// inserts the path of {code} into the trie, ending in a leaf for {x}
+		int i = 0;
+		for (auto n = code.length; n > 1; --n) {
+			auto bit = (code.bits >> (n - 1)) & 1;
+			if (!table[i][bit]) {
+				table[i][bit] = static_cast<int>(table.size());
+				table.push_back({{0, 0}});
+			}
+			i = table[i][bit];
+		}
+		if (code.length) table[i][code.bits & 1] = -static_cast<int>(symbols.size()) - 1;
+		symbols.push_back(x);
+	}
+
+	template <typename I, typename SymbolCodec>
+	I read_header(I first, SymbolCodec& codec) {
+		nodes.assign(read_bits<16>(first), std::pair<int, T>{});
 		auto lnodes = 0;
 		auto inodes = nodes.size() / 2 + 1;
-		auto first = input.begin() + 16;
 
 		for (unsigned i = 0; i < nodes.size(); ++i) {
-			T x;
+			T x{};
 			bool isleaf = *first == '1';
 			++first;
 			if (isleaf) {
-				x = converter(input.substr(first - input.begin(), sizeof(T) * 8));
-				first += sizeof(T) * 8;
+				x = codec.read(first);
 				nodes[lnodes++] = std::make_pair(i, x);
 			} else {
 				nodes[inodes++] = std::make_pair(i, x);
@@ -202,6 +561,3 @@ private:
 		return first;
 	}
 };
-
-
-
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include "compress.h"
+
+// Integer arrays are delta coded, zigzag mapped so small negative deltas stay small,
+// split into little-endian base-128 varint bytes and the byte stream is Huffman coded
+// per block. Sorted ids and timestamps turn into mostly one-byte deltas.
+
+template <typename T>
+// requires UnsignedIntegral<T>
+T zigzag_encode(T x) {
+	// x holds a two's complement delta
+	return (x << 1) ^ (0 - (x >> (std::numeric_limits<T>::digits - 1)));
+}
+
+template <typename T>
+// requires UnsignedIntegral<T>
+T zigzag_decode(T x) {
+	return (x >> 1) ^ (0 - (x & 1));
+}
+
+template <typename T>
+// requires UnsignedIntegral<T>
+void delta_encode(const T* x, std::size_t n, T* result) {
+	// every difference reads only the input, so there is no loop carried dependency and
+	// the loop vectorizes
+	if (!n) return;
+	result[0] = zigzag_encode(x[0]);
+	for (std::size_t i = 1; i < n; ++i) result[i] = zigzag_encode<T>(x[i] - x[i - 1]);
+}
+
+template <typename I, typename O>
+// requires InputIterator<I>
+// requires OutputIterator<O>
+O delta_decode(I first, I last, O result) {
+	ValueType<I> sum{0};
+	while (first != last) {
+		sum += zigzag_decode<ValueType<I>>(*first);
+		*result = sum;
+		++result;
+		++first;
+	}
+	return result;
+}
+
+template <typename T, typename O>
+// requires UnsignedIntegral<T>
+// requires OutputIterator<O>
+O varint_encode(T x, O result) {
+	while (x >= 0x80) {
+		*result = static_cast<char>((x & 0x7f) | 0x80);
+		++result;
+		x >>= 7;
+	}
+	*result = static_cast<char>(x);
+	return ++result;
+}
+
+template <typename T, typename I>
+// requires UnsignedIntegral<T>
+// requires InputIterator<I>
+T varint_decode(I& first) {
+	T x{0};
+	unsigned shift = 0;
+	while (true) {
+		auto byte = static_cast<unsigned char>(*first);
+		++first;
+		x |= static_cast<T>(byte & 0x7f) << shift;
+		if (!(byte & 0x80)) return x;
+		shift += 7;
+	}
+}
+
+template <typename I>
+// requires ForwardIterator<I>
+// requires UnsignedIntegral<ValueType<I>>
+std::string encode_integers(I first, I last, std::size_t block_size = default_block_size) {
+	using T = ValueType<I>;
+	std::vector<T> values(first, last);
+	std::vector<T> deltas(values.size());
+	delta_encode(values.data(), values.size(), deltas.data());
+
+	std::string bytes;
+	bytes.reserve(deltas.size());
+	for (T x : deltas) varint_encode(x, std::back_inserter(bytes));
+
+	return compress_blocks(bytes, block_size);
+}
+
+template <typename T, typename O>
+// requires UnsignedIntegral<T>
+// requires OutputIterator<O>
+O decode_integers(const std::string& input, O result) {
+	std::string bytes = decompress_blocks(input);
+	std::vector<T> deltas;
+	auto first = bytes.cbegin();
+	while (first != bytes.cend()) deltas.push_back(varint_decode<T>(first));
+	return delta_decode(deltas.begin(), deltas.end(), result);
+}
+
+template <typename I>
+// requires ForwardIterator<I>
+std::string encode_uint32(I first, I last) {
+	static_assert(std::is_same<ValueType<I>, std::uint32_t>::value, "expected uint32_t values");
+	return encode_integers(first, last);
+}
+
+template <typename I>
+// requires ForwardIterator<I>
+std::string encode_uint64(I first, I last) {
+	static_assert(std::is_same<ValueType<I>, std::uint64_t>::value, "expected uint64_t values");
+	return encode_integers(first, last);
+}
+
+template <typename O>
+// requires OutputIterator<O>
+O decode_uint32(const std::string& input, O result) {
+	return decode_integers<std::uint32_t>(input, result);
+}
+
+template <typename O>
+// requires OutputIterator<O>
+O decode_uint64(const std::string& input, O result) {
+	return decode_integers<std::uint64_t>(input, result);
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "compress.h"
+
+// Order-1 context modeling: the previous byte selects the Huffman table of the next one.
+// Contexts are clustered into at most {max_context_tables} tables so the headers and the
+// decode tables stay small. The first byte is coded in context 0.
+
+constexpr std::size_t max_context_tables = 16;
+
+inline std::string compress_order1(const std::string& input, std::size_t max_tables = max_context_tables) {
+	// precondition: 0 < max_tables && max_tables <= max_context_tables
+	std::vector<byte_histogram> contexts(256);
+	unsigned char previous = 0;
+	for (char x : input) {
+		++contexts[previous][static_cast<unsigned char>(x)];
+		previous = static_cast<unsigned char>(x);
+	}
+
+	std::vector<std::size_t> used;
+	std::vector<byte_histogram> histograms;
+	for (std::size_t i = 0; i < contexts.size(); ++i) {
+		if (distinct_symbols(contexts[i])) {
+			used.push_back(i);
+			histograms.push_back(contexts[i]);
+		}
+	}
+	auto clusters = cluster_histograms(histograms, max_tables);
+
+	std::vector<std::size_t> selectors(256, max_context_tables);
+	std::vector<byte_histogram> tables;
+	for (std::size_t i = 0; i < used.size(); ++i) {
+		selectors[used[i]] = clusters[i];
+		if (clusters[i] == tables.size()) tables.emplace_back();
+		tables[clusters[i]] += histograms[i];
+	}
+
+	std::string result;
+	write_bits<32>(result, input.size());
+	write_bits<5>(result, tables.size());
+	for (auto x : selectors) {
+		if (x == max_context_tables) {
+			result += '0';
+		} else {
+			result += '1';
+			write_bits<4>(result, x);
+		}
+	}
+
+	std::vector<code_table> codes;
+	for (const auto& x : build_tables(tables, codes)) result += x;
+
+	previous = 0;
+	for (char x : input) {
+		result += codes[selectors[previous]][x];
+		previous = static_cast<unsigned char>(x);
+	}
+	return result;
+}
+
+inline std::string decompress_order1(const std::string& input) {
+	auto first = input.begin();
+	auto n = read_bits<32>(first);
+	std::vector<huffman_decoder<char>> decoders(read_bits<5>(first));
+	std::vector<std::size_t> selectors(256);
+	for (auto& x : selectors) {
+		bool used = *first == '1';
+		++first;
+		if (used) x = read_bits<4>(first);
+	}
+	for (auto& decoder : decoders) first = decoder.read_canonical_table(first, byte_codec{});
+
+	std::string result;
+	result.reserve(n);
+	unsigned char previous = 0;
+	while (n) {
+		--n;
+		char x = decoders[selectors[previous]].decode(first);
+		result += x;
+		previous = static_cast<unsigned char>(x);
+	}
+	return result;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+#include "ans.h"
+#include "huffman.h"
+
+// Per-thread buffers for the temporaries of coding one block. Their users clear them
+// but never shrink them, so once a thread has coded its largest block, further blocks
+// allocate nothing for these temporaries and threads do not contend in malloc for
+// them. A buffer may have several users, such as the symbol decoder of run-length and
+// move-to-front blocks, but none of them calls another user of its buffer while it
+// holds it.
+
+struct block_scratch {
+	std::string sampled; // mtf_cost
+	std::string sampled_ranks; // mtf_cost
+	std::string ranks; // move-to-front blocks
+	std::vector<std::size_t> digrams; // count_digrams
+	ans_buffers ans; // tANS blocks
+	std::vector<std::pair<std::size_t, char>> frequencies; // build_table
+	huffman_decoder<char> symbols; // move-to-front and run-length blocks
+	huffman_decoder<char> lengths; // run-length blocks
+	huffman_decoder<std::uint16_t> digram_decoder; // digram blocks
+	huffman_decoder<char> previous; // decompress_blocks
+	std::vector<huffman_decoder<char>> shared; // decompress_blocks
+};
+
+inline block_scratch& thread_scratch() {
+	thread_local block_scratch scratch;
+	return scratch;
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+#include <string>
+#include <vector>
+#include "compress.h"
+
+// Chooses block boundaries by the exact size of the coded blocks. The input is cut into
+// candidate chunks whose size halves as {level} grows; low levels greedily extend a
+// block while absorbing the next chunk is no worse than starting a new one, high levels
+// run a dynamic program over the chunk boundaries. Every level starts from the
+// boundaries of the level below, which are also chunk boundaries, and keeps them when
+// they cost less, so by this estimate a higher level is never worse than a lower one.
+
+constexpr int max_split_level = 9;
+constexpr int optimal_split_level = 6;
+constexpr std::size_t min_split_granularity = 128;
+constexpr std::size_t max_split_candidates = 64;
+
+inline std::vector<std::size_t> refine_offsets(const std::string& input, const std::vector<std::size_t>& coarser, std::size_t granularity, bool optimal) {
+	// the boundaries of one level, given those of the level below ({coarser}), which
+	// are multiples of {granularity}
+	// Only the histograms of a block being grown or of the last {max_split_candidates}
+	// chunks are kept, so the memory does not grow with the input.
+	auto chunks = fixed_blocks(input.size(), granularity);
+	auto histogram = [&](std::size_t i) {
+		return count_bytes(input.begin() + chunks[i].first, input.begin() + chunks[i].second);
+	};
+	// the boundaries of the coarser level counted in chunks, and the cost of its blocks
+	std::vector<std::size_t> seeds;
+	std::vector<std::size_t> seed_cost{0};
+	for (std::size_t k = 0; k < coarser.size(); ++k) {
+		seeds.push_back((coarser[k] + granularity - 1) / granularity);
+		if (k) seed_cost.push_back(huffman_cost(count_bytes(input.begin() + coarser[k - 1], input.begin() + coarser[k])));
+	}
+
+	std::vector<std::size_t> cuts{0};
+	if (!optimal) {
+		auto block = histogram(0);
+		auto current = huffman_cost(block);
+		std::size_t bits = 0;
+		for (std::size_t j = 1; j < chunks.size(); ++j) {
+			auto next = histogram(j);
+			auto merged = block;
+			merged += next;
+			auto merged_cost = huffman_cost(merged);
+			auto next_cost = huffman_cost(next);
+			if (merged_cost <= current + next_cost) {
+				block = merged;
+				current = merged_cost;
+			} else {
+				cuts.push_back(j);
+				bits += current;
+				block = next;
+				current = next_cost;
+			}
+		}
+		cuts.push_back(chunks.size());
+		bits += current;
+		std::size_t seeded = 0;
+		for (auto x : seed_cost) seeded += x;
+		if (seeded <= bits) return coarser;
+	} else {
+		// best[j] is the cheapest coding of the first j chunks, ending in a block that
+		// starts at chunk from[j]: one of the last {max_split_candidates} chunks, or the
+		// coarser boundary before j when j is a coarser boundary
+		std::vector<std::size_t> best(chunks.size() + 1, std::numeric_limits<std::size_t>::max());
+		std::vector<std::size_t> from(chunks.size() + 1);
+		std::vector<byte_histogram> window(std::min(max_split_candidates, chunks.size()));
+		best[0] = 0;
+		for (std::size_t j = 1, k = 1; j <= chunks.size(); ++j) {
+			auto consider = [&](std::size_t i, std::size_t bits) {
+				auto x = best[i] + bits;
+				if (x < best[j]) {
+					best[j] = x;
+					from[j] = i;
+				}
+			};
+			window[(j - 1) % window.size()] = histogram(j - 1);
+			// the blocks ending at j, grown backwards one chunk at a time
+			byte_histogram h{};
+			for (auto i = j; i-- > (j > max_split_candidates ? j - max_split_candidates : 0);) {
+				h += window[i % window.size()];
+				consider(i, huffman_cost(h));
+			}
+			if (seeds[k] != j) continue;
+			if (seeds[k - 1] + max_split_candidates < j) consider(seeds[k - 1], seed_cost[k]);
+			++k;
+		}
+		std::vector<std::size_t> reversed;
+		for (auto j = chunks.size(); j; j = from[j]) reversed.push_back(j);
+		cuts.insert(cuts.end(), reversed.rbegin(), reversed.rend());
+	}
+
+	std::vector<std::size_t> offsets;
+	for (auto x : cuts) offsets.push_back(x < chunks.size() ? chunks[x].first : input.size());
+	return offsets;
+}
+
+inline std::vector<std::size_t> split_offsets(const std::string& input, int level) {
+	// the block boundaries of {level} as byte offsets, from 0 to input.size()
+	// precondition: 0 <= level && level <= max_split_level
+	std::vector<std::size_t> offsets;
+	for (const auto& x : fixed_blocks(input.size(), default_block_size)) offsets.push_back(x.first);
+	offsets.push_back(input.size());
+	for (int k = 1; k <= level; ++k) {
+		auto granularity = std::max(min_split_granularity, default_block_size >> k);
+		offsets = refine_offsets(input, offsets, granularity, k >= optimal_split_level);
+	}
+	return offsets;
+}
+
+inline block_bounds split_blocks(const std::string& input, int level) {
+	// precondition: 0 <= level && level <= max_split_level
+	if (input.empty()) return block_bounds{};
+	auto offsets = split_offsets(input, level);
+	block_bounds blocks;
+	for (std::size_t i = 1; i < offsets.size(); ++i) blocks.emplace_back(offsets[i - 1], offsets[i]);
+	return blocks;
+}
+
+inline std::string compress_split(const std::string& input, int level, std::size_t shared_tables = 0) {
+	return compress_blocks(input, split_blocks(input, level), shared_tables);
+}
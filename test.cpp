@@ -0,0 +1,228 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "adaptive_huffman.h"
+#include "compress.h"
+#include "integers.h"
+#include "order1.h"
+#include "split.h"
+#include "tokens.h"
+#include "tunstall.h"
+#include "utf8.h"
+
+// Round trips every coding mode over a few inputs that reach its special cases.
+
+int failures = 0;
+
+void check(const std::string& name, bool ok) {
+	if (ok) return;
+	std::cout << "FAIL " << name << "\n";
+	++failures;
+}
+
+std::vector<std::string> inputs() {
+	std::mt19937 rng{42};
+	std::geometric_distribution<int> symbol{0.15};
+	std::string skewed, noise, runs;
+	for (std::size_t i = 0; i < (1 << 16); ++i) skewed += static_cast<char>('a' + symbol(rng) % 26);
+	for (std::size_t i = 0; i < (1 << 15); ++i) noise += static_cast<char>(rng());
+	for (std::size_t i = 0; i < (1 << 16); ++i) runs += static_cast<char>('a' + (i >> 9) % 3);
+	return {"a", "abracadabra", std::string(100000, 'z'), skewed, noise, runs, skewed.substr(0, 20000) + noise.substr(0, 20000) + runs.substr(0, 20000)};
+}
+
+std::string text() {
+	std::string result;
+	for (std::size_t i = 0; i < 5000; ++i) {
+		result += "2024-01-01 12:00:" + std::to_string(i % 60) + " INFO request " + std::to_string(i % 97) + " served\n";
+	}
+	return result;
+}
+
+std::vector<block_type> block_types(const std::string& frame) {
+	// the type of every block of a frame without shared tables
+	auto first = frame.begin();
+	auto n = read_bits<32>(first);
+	read_bits<5>(first);
+	std::vector<block_type> result;
+	while (n--) {
+		result.push_back(static_cast<block_type>(read_bits<block_type_bits>(first)));
+		read_bits<32>(first);
+		first += read_bits<32>(first);
+	}
+	return result;
+}
+
+bool coded_as(const std::string& x, block_type type) {
+	auto frame = compress_blocks(x, x.size());
+	return decompress_blocks(frame) == x && block_types(frame) == std::vector<block_type>{type};
+}
+
+void block_choice() {
+	std::mt19937 rng{7};
+	for (unsigned m : {2, 4, 16}) {
+		std::string x;
+		for (std::size_t i = 0; i < 10000; ++i) x += static_cast<char>('0' + rng() % m);
+		check("packed " + std::to_string(m) + " values", coded_as(x, block_type::packed));
+	}
+	// bursts of three byte values, a new three every 256 bytes
+	std::string bursts;
+	for (std::size_t i = 0; i < 64; ++i) {
+		char burst[3];
+		for (auto& x : burst) x = static_cast<char>(rng());
+		for (std::size_t j = 0; j < 256; ++j) bursts += burst[rng() % 3];
+	}
+	check("mtf", coded_as(bursts, block_type::mtf));
+	// 92% 'a', the rest pairs that always start at an even offset, and an odd length
+	std::bernoulli_distribution pair{0.08};
+	std::string digrams;
+	while (digrams.size() < 20000) {
+		auto k = rng() % 16;
+		digrams += pair(rng) ? std::string{static_cast<char>('A' + k), static_cast<char>('A' + (k * 7 + 3) % 64)} : "aa";
+	}
+	digrams += 'a';
+	auto a = static_cast<std::size_t>(std::count(digrams.begin(), digrams.end(), 'a'));
+	check("digram", a * 10 > digrams.size() * 9 && coded_as(digrams, block_type::digram));
+	// blocks with the same statistics code all but the first with its table
+	std::geometric_distribution<int> symbol{0.15};
+	std::string repeated;
+	for (std::size_t i = 0; i < 8 * 4096; ++i) repeated += static_cast<char>('a' + symbol(rng) % 26);
+	auto frame = compress_blocks(repeated, 4096);
+	std::vector<block_type> types(8, block_type::repeat_table);
+	types[0] = block_type::huffman;
+	check("repeat table", decompress_blocks(frame) == repeated && block_types(frame) == types);
+	for (double p : {0.1, 0.03}) {
+		// the entropy is 0.47 and 0.19 bits per byte
+		std::bernoulli_distribution one{p};
+		std::string binary;
+		for (std::size_t i = 0; i < (1 << 16); ++i) binary += one(rng) ? '1' : '0';
+		frame = compress_blocks(binary);
+		check("skewed binary", decompress_blocks(frame) == binary && frame.size() < binary.size() * (p * 5 + 0.1));
+	}
+}
+
+void sampling() {
+	// a block large enough to be sampled, where the sample misses one byte value
+	std::mt19937 rng{3};
+	std::geometric_distribution<int> symbol{0.15};
+	std::string x;
+	for (std::size_t i = 0; i < min_sampled_block; ++i) x += static_cast<char>('a' + symbol(rng) % 26);
+	auto exact = compress_blocks(x, x.size());
+	auto sampled = compress_blocks(x, x.size(), 0, true);
+	check("sampled", decompress_blocks(sampled) == x && block_types(sampled) == block_types(exact));
+	// the run of the first stratum starts at its first byte
+	x[sample_run] = '!';
+	check("sample misses a byte", !sample_bytes(x.begin(), x.end())['!']);
+	exact = compress_blocks(x, x.size());
+	sampled = compress_blocks(x, x.size(), 0, true);
+	check("sampled with a missed byte", decompress_blocks(sampled) == x && sampled.size() < exact.size() * 1.01);
+}
+
+void bytes() {
+	for (const auto& x : inputs()) {
+		check("compress", decompress(compress(x)) == x);
+		check("compress blocks", decompress_blocks(compress_blocks(x)) == x);
+		check("compress shared tables", decompress_blocks(compress_blocks(x, 4096, 8)) == x);
+		check("compress shared tables of many blocks", decompress_blocks(compress_blocks(x, 128, 8)) == x);
+		check("compress sampled", decompress_blocks(compress_blocks(x, 1 << 20, 0, true)) == x);
+		check("order1", decompress_order1(compress_order1(x)) == x);
+		check("adaptive", decompress_adaptive(compress_adaptive(x)) == x);
+		check("tunstall", decompress_tunstall(compress_tunstall(x)) == x);
+		check("utf8", decompress_utf8(compress_utf8(x)) == x);
+		check("tokens", decompress_tokens(compress_tokens(x)) == x);
+		for (int level = 0; level <= max_split_level; level += 3) {
+			check("split", decompress_blocks(compress_split(x, level)) == x);
+		}
+	}
+	check("compress blocks empty", decompress_blocks(compress_blocks(std::string{})).empty());
+	std::string cached = "aaaabbbc";
+	auto thrown = false;
+	try {
+		compress("abcd", count_bytes(cached.begin(), cached.end()));
+	} catch (const std::invalid_argument&) {
+		thrown = true;
+	}
+	check("compress with a stale histogram", thrown);
+	check("tunstall of one byte value", compress_tunstall(std::string(100000, 'z')).size() < 100);
+	auto t = text();
+	check("tokens text", decompress_tokens(compress_tokens(t)) == t);
+	std::string u = "\xd0\x9f\xd1\x80\xd0\xb8\xd0\xb2\xd0\xb5\xd1\x82 \xe4\xb8\x96\xe7\x95\x8c \xf0\x9f\x98\x80 ";
+	for (int i = 0; i < 10; ++i) u += u;
+	check("utf8 text", decompress_utf8(compress_utf8(u)) == u);
+}
+
+void integers() {
+	std::vector<std::uint32_t> x;
+	std::vector<std::uint64_t> y;
+	std::mt19937_64 rng{42};
+	std::uint64_t v = 0;
+	for (std::size_t i = 0; i < 100000; ++i) {
+		v += rng() % 1000;
+		x.push_back(static_cast<std::uint32_t>(i % 7 ? v : rng()));
+		y.push_back(i % 5 ? v : rng());
+	}
+	std::vector<std::uint32_t> x2;
+	std::vector<std::uint64_t> y2;
+	decode_uint32(encode_uint32(x.begin(), x.end()), std::back_inserter(x2));
+	decode_uint64(encode_uint64(y.begin(), y.end()), std::back_inserter(y2));
+	check("uint32", x2 == x);
+	check("uint64", y2 == y);
+}
+
+void tables() {
+	code_lengths lengths{};
+	lengths['a'] = 1;
+	lengths['b'] = 2;
+	lengths['c'] = 2;
+	code_table codes;
+	build_table_from_lengths(lengths, codes);
+	check("table from lengths", codes.at('a').size() == 1 && codes.at('b').size() == 2 && codes.at('c').size() == 2 && codes.at('a')[0] != codes.at('b')[0] && codes.at('b') != codes.at('c'));
+	auto rejected = [](const code_lengths& x) {
+		code_table codes;
+		try {
+			build_table_from_lengths(x, codes);
+		} catch (const std::invalid_argument&) {
+			return true;
+		}
+		return false;
+	};
+	check("table from no lengths", rejected(code_lengths{}));
+	lengths['d'] = 1;
+	check("table from lengths over the Kraft sum", rejected(lengths));
+	code_lengths longest{};
+	longest['a'] = 1;
+	longest['b'] = 64;
+	check("table from a length of 64 bits", rejected(longest));
+}
+
+void hash_codes() {
+	perfect_hash_codes<int> codes;
+	for (int i = 0; i < 1000; ++i) codes.insert(std::make_pair(i * 7, std::string(i % 20 + 1, '1')));
+	codes.seal();
+	auto found = true;
+	for (int i = 0; i < 1000; ++i) found = found && codes[i * 7].length == static_cast<unsigned>(i % 20 + 1);
+	check("perfect hash lookup", found);
+	auto thrown = false;
+	try {
+		codes[3];
+	} catch (const std::out_of_range&) {
+		thrown = true;
+	}
+	check("perfect hash missing symbol", thrown);
+}
+
+int main() {
+	bytes();
+	block_choice();
+	sampling();
+	integers();
+	tables();
+	hash_codes();
+	if (!failures) std::cout << "all round trips passed\n";
+	return failures != 0;
+}
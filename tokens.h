@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cctype>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "compress.h"
+#include "integers.h"
+
+// Token mode for repetitive text such as log lines: the input is split into words and
+// the separators between them, every distinct token gets a 16-bit id and huffman_encoder
+// codes the ids. The vocabulary is sent once as varint lengths and token bytes, itself
+// compressed as byte blocks, and the decoder copies whole tokens out of it.
+
+template <typename I, typename O>
+// requires ForwardIterator<I>
+// requires OutputIterator<O, std::pair<I, I>>
+O tokenize(I first, I last, O result) {
+	// alternating runs of alphanumeric and other characters
+	while (first != last) {
+		auto word = std::isalnum(static_cast<unsigned char>(*first)) != 0;
+		auto start = first;
+		do {
+			++first;
+		} while (first != last && (std::isalnum(static_cast<unsigned char>(*first)) != 0) == word);
+		*result = std::make_pair(start, first);
+		++result;
+	}
+	return result;
+}
+
+inline std::string compress_tokens(const std::string& input) {
+	using T = DifferenceType<typename std::string::iterator>;
+	using token = std::pair<std::string::const_iterator, std::string::const_iterator>;
+
+	std::vector<token> tokens;
+	tokenize(input.begin(), input.end(), std::back_inserter(tokens));
+
+	std::unordered_map<std::string, std::uint16_t> ids;
+	std::vector<std::uint16_t> stream;
+	std::vector<std::pair<T, std::uint16_t>> frequencies;
+	std::string vocabulary;
+	stream.reserve(tokens.size());
+	for (const auto& x : tokens) {
+		auto id = ids.emplace(std::string(x.first, x.second), static_cast<std::uint16_t>(ids.size()));
+		if (id.second) {
+			if (ids.size() > max_header_symbols) return '0' + compress_blocks(input);
+			varint_encode(static_cast<std::size_t>(x.second - x.first), std::back_inserter(vocabulary));
+			vocabulary.append(x.first, x.second);
+			frequencies.emplace_back(0, id.first->second);
+		}
+		++frequencies[id.first->second].first;
+		stream.push_back(id.first->second);
+	}
+	if (stream.empty()) return '0' + compress_blocks(input);
+
+	// the ids are 0, 1, ..., ids.size() - 1, so their codes are indexed by id
+	dense_codes<std::uint16_t> codes{ids.size()};
+	sort_frequencies(frequencies);
+
+	std::string result{'1'};
+	auto compressed = compress_blocks(vocabulary);
+	write_bits<32>(result, compressed.size());
+	result += compressed;
+	write_bits<32>(result, stream.size());
+	result += with_huffman_encoder(frequencies, build_codes<digram_codec, dense_codes<std::uint16_t>>{codes});
+	for (auto x : stream) append_code(result, codes[x]);
+	return result;
+}
+
+inline std::string decompress_tokens(const std::string& input) {
+	auto first = input.begin();
+	if (*first == '0') return decompress_blocks(std::string(first + 1, input.end()));
+	++first;
+
+	// the offset and length of every token in the vocabulary, so each code is a single copy
+	auto size = read_bits<32>(first);
+	auto vocabulary = decompress_blocks(std::string(first, first + size));
+	first += size;
+	std::vector<std::pair<std::size_t, std::size_t>> entries;
+	for (auto x = vocabulary.cbegin(); x != vocabulary.cend();) {
+		auto length = varint_decode<std::size_t>(x);
+		entries.emplace_back(x - vocabulary.cbegin(), length);
+		x += length;
+	}
+
+	auto n = read_bits<32>(first);
+	huffman_decoder<std::uint16_t> decoder;
+	first = decoder.read_table(first, digram_codec{});
+	std::string result;
+	while (n) {
+		--n;
+		const auto& x = entries[decoder.decode(first)];
+		result.append(vocabulary, x.first, x.second);
+	}
+	return result;
+}
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <queue>
+#include <string>
+#include <utility>
+#include <vector>
+#include "bits.h"
+#include "histogram.h"
+
+// Tunstall coding maps variable length strings of input bytes to fixed width codewords,
+// so decoding is a table copy per codeword with no dependency between the bits. The
+// dictionary is rebuilt by the decoder from the histogram sent in the header: starting
+// from the single bytes, the most probable word is repeatedly extended by every byte of
+// the alphabet while the words still fit in 2^{bits} codewords.
+
+constexpr std::size_t default_tunstall_bits = 12;
+
+class tunstall_dictionary {
+private:
+	struct node {
+		int first_child; // children are stored together in alphabet order, -1 for a word
+		int codeword;
+	};
+	std::vector<node> nodes;
+	std::vector<unsigned char> alphabet;
+	std::array<int, 256> ranks;
+public:
+	tunstall_dictionary(const byte_histogram& h, std::size_t bits) {
+		std::size_t total = 0;
+		ranks.fill(-1);
+		for (std::size_t i = 0; i < h.size(); ++i) {
+			if (!h[i]) continue;
+			ranks[i] = static_cast<int>(alphabet.size());
+			alphabet.push_back(static_cast<unsigned char>(i));
+			total += h[i];
+		}
+		auto m = alphabet.size();
+		nodes.push_back({-1, -1});
+		if (m) {
+			// expand the most probable word, ties go to the word created last
+			std::priority_queue<std::pair<double, int>> words;
+			std::vector<double> probabilities{1.0};
+			std::size_t size = 1;
+			words.emplace(1.0, 0);
+			do {
+				auto x = words.top().second;
+				words.pop();
+				nodes[x].first_child = static_cast<int>(nodes.size());
+				for (auto symbol : alphabet) {
+					double p = probabilities[x] * h[symbol] / total;
+					words.emplace(p, static_cast<int>(nodes.size()));
+					probabilities.push_back(p);
+					nodes.push_back({-1, -1});
+				}
+				size += m - 1;
+			} while (m > 1 && size + m - 1 <= (std::size_t{1} << bits));
+		}
+
+		int codeword = 0;
+		for (auto& x : nodes) {
+			if (x.first_child == -1) x.codeword = codeword++;
+		}
+	}
+
+	template <typename I>
+	// requires InputIterator<I>
+	int parse(I& first, I last) const {
+		// consumes the longest word at {first} and returns its codeword; at the end of the
+		// input a shorter prefix is completed with any word that extends it
+		auto x = 0;
+		while (nodes[x].first_child != -1) {
+			auto child = nodes[x].first_child;
+			if (first != last) {
+				child += ranks[static_cast<unsigned char>(*first)];
+				++first;
+			}
+			x = child;
+		}
+		return nodes[x].codeword;
+	}
+
+	std::vector<std::string> words() const {
+		// the word of every codeword, in codeword order
+		std::vector<std::string> result;
+		std::vector<std::pair<int, std::string>> stack{{0, std::string{}}};
+		std::vector<std::pair<int, std::string>> leaves;
+		while (!stack.empty()) {
+			auto x = stack.back();
+			stack.pop_back();
+			if (nodes[x.first].first_child == -1) {
+				leaves.push_back(x);
+				continue;
+			}
+			for (std::size_t i = 0; i < alphabet.size(); ++i) {
+				stack.emplace_back(nodes[x.first].first_child + static_cast<int>(i), x.second + static_cast<char>(alphabet[i]));
+			}
+		}
+		result.resize(leaves.size());
+		for (auto& x : leaves) result[nodes[x.first].codeword] = std::move(x.second);
+		return result;
+	}
+};
+
+inline std::string compress_tunstall(const std::string& input, std::size_t bits = default_tunstall_bits) {
+	// precondition: 8 <= bits && bits < 32
+	auto h = count_bytes(input.begin(), input.end());
+	std::string result;
+	write_bits<32>(result, input.size());
+	write_bits<5>(result, bits);
+	write_bits<9>(result, distinct_symbols(h));
+	for (std::size_t i = 0; i < h.size(); ++i) {
+		if (!h[i]) continue;
+		write_bits<8>(result, i);
+		write_bits<32>(result, h[i]);
+	}
+
+	// a single byte value is already given by the header, as in a single symbol block
+	if (distinct_symbols(h) < 2) return result;
+
+	tunstall_dictionary dictionary{h, bits};
+	auto first = input.begin();
+	while (first != input.end()) write_bits(result, dictionary.parse(first, input.end()), bits);
+	return result;
+}
+
+inline std::string decompress_tunstall(const std::string& input) {
+	auto first = input.begin();
+	auto n = read_bits<32>(first);
+	auto bits = read_bits<5>(first);
+	byte_histogram h{};
+	auto m = read_bits<9>(first);
+	std::size_t x = 0;
+	for (auto i = m; i; --i) {
+		x = read_bits<8>(first);
+		h[x] = read_bits<32>(first);
+	}
+	if (m == 1) return std::string(n, static_cast<char>(x));
+
+	// lay the words out back to back so each codeword is a single copy
+	auto words = tunstall_dictionary{h, bits}.words();
+	std::string table;
+	std::vector<std::pair<std::size_t, std::size_t>> entries;
+	for (const auto& x : words) {
+		entries.emplace_back(table.size(), x.size());
+		table += x;
+	}
+
+	std::string result;
+	result.reserve(n + table.size());
+	while (first != input.end()) {
+		const auto& x = entries[read_bits(first, bits)];
+		result.append(table, x.first, x.second);
+	}
+	result.resize(n);
+	return result;
+}
@@ -0,0 +1,168 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "compress.h"
+
+// Code point mode for UTF-8 text: the input is decoded into Unicode code points and
+// huffman_encoder is instantiated over them, so every character of CJK or Cyrillic text
+// gets a single code instead of two or three skewed byte codes. Input that is not valid
+// UTF-8, or that uses more code points than a header can hold, is coded as bytes.
+
+class code_point_codec {
+	// Leaves are written as the zigzag coded difference from the previous leaf, in a
+	// 5-bit width and that many bits. The code points of one script lie close together,
+	// so most leaves take well under the 32 bits of a char32_t.
+private:
+	std::uint32_t previous = 0;
+public:
+	void write(std::string& result, char32_t x) {
+		// precondition: x <= 0x10ffff
+		auto d = static_cast<std::uint32_t>(x - previous);
+		auto z = (d << 1) ^ (0 - (d >> 31));
+		std::size_t width = 0;
+		while (z >> width) ++width;
+		write_bits<5>(result, width);
+		write_bits(result, z, width);
+		previous = x;
+	}
+
+	template <typename I>
+	// requires InputIterator<I>
+	char32_t read(I& first) {
+		auto z = static_cast<std::uint32_t>(read_bits(first, read_bits<5>(first)));
+		previous += (z >> 1) ^ (0 - (z & 1));
+		return previous;
+	}
+};
+
+template <typename I, typename O>
+// requires RandomAccessIterator<I>
+// requires OutputIterator<O, char32_t>
+bool utf8_decode(I first, I last, O& result) {
+	// returns false at the first malformed, overlong, surrogate or out of range sequence
+	while (first != last) {
+		// ASCII fast path, eight bytes at a time
+		while (last - first >= 8) {
+			std::uint64_t x;
+			std::memcpy(&x, &*first, 8);
+			if (x & 0x8080808080808080ull) break;
+			for (int i = 0; i < 8; ++i) {
+				*result = static_cast<char32_t>(first[i]);
+				++result;
+			}
+			first += 8;
+		}
+		if (first == last) break;
+
+		auto byte = static_cast<unsigned char>(*first);
+		++first;
+		std::size_t n;
+		char32_t x;
+		if (byte < 0x80) {
+			n = 0;
+			x = byte;
+		} else if ((byte & 0xe0) == 0xc0) {
+			n = 1;
+			x = byte & 0x1f;
+		} else if ((byte & 0xf0) == 0xe0) {
+			n = 2;
+			x = byte & 0x0f;
+		} else if ((byte & 0xf8) == 0xf0) {
+			n = 3;
+			x = byte & 0x07;
+		} else {
+			return false;
+		}
+		if (static_cast<std::size_t>(last - first) < n) return false;
+		for (std::size_t i = 0; i < n; ++i) {
+			auto next = static_cast<unsigned char>(*first);
+			++first;
+			if ((next & 0xc0) != 0x80) return false;
+			x = (x << 6) | (next & 0x3f);
+		}
+		static const char32_t min[] = {0, 0x80, 0x800, 0x10000};
+		if (x < min[n] || x > 0x10ffff || (x >= 0xd800 && x <= 0xdfff)) return false;
+		*result = x;
+		++result;
+	}
+	return true;
+}
+
+inline void utf8_encode(char32_t x, std::string& result) {
+	if (x < 0x80) {
+		result += static_cast<char>(x);
+	} else if (x < 0x800) {
+		result += static_cast<char>(0xc0 | (x >> 6));
+		result += static_cast<char>(0x80 | (x & 0x3f));
+	} else if (x < 0x10000) {
+		result += static_cast<char>(0xe0 | (x >> 12));
+		result += static_cast<char>(0x80 | ((x >> 6) & 0x3f));
+		result += static_cast<char>(0x80 | (x & 0x3f));
+	} else {
+		result += static_cast<char>(0xf0 | (x >> 18));
+		result += static_cast<char>(0x80 | ((x >> 12) & 0x3f));
+		result += static_cast<char>(0x80 | ((x >> 6) & 0x3f));
+		result += static_cast<char>(0x80 | (x & 0x3f));
+	}
+}
+
+inline std::string compress_utf8(const std::string& input) {
+	using T = DifferenceType<typename std::string::iterator>;
+	using Op = merge_first_op<T, std::plus<T>>;
+	using Compare = compare_first<T, char32_t, std::less<T>>;
+
+	std::vector<char32_t> code_points;
+	code_points.reserve(input.size());
+	auto out = std::back_inserter(code_points);
+	auto valid = utf8_decode(input.begin(), input.end(), out);
+	std::unordered_map<char32_t, T> counts;
+	if (valid) {
+		for (auto x : code_points) ++counts[x];
+	}
+	if (!valid || code_points.empty() || counts.size() > max_header_symbols) {
+		return '0' + compress_blocks(input);
+	}
+
+	std::vector<std::pair<T, char32_t>> frequencies;
+	for (const auto& x : counts) frequencies.emplace_back(x.second, x.first);
+
+	Op op{std::plus<T>{}};
+	Compare cmp{std::less<T>{}};
+
+	// ties are ordered by code point so the header does not depend on the hash order
+	std::sort(frequencies.begin(), frequencies.end(), [](const std::pair<T, char32_t>& x, const std::pair<T, char32_t>& y) {
+		return x.first < y.first || (x.first == y.first && x.second < y.second);
+	});
+	huffman_encoder<std::pair<T, char32_t>, Compare, Op> encoder{frequencies, cmp, op};
+	perfect_hash_codes<char32_t> codes;
+
+	std::string result{'1'};
+	write_bits<32>(result, code_points.size());
+	result += encoder.build(get_second<T, char32_t>{}, code_point_codec{}, codes);
+	codes.seal();
+	for (auto x : code_points) append_code(result, codes[x]);
+	return result;
+}
+
+inline std::string decompress_utf8(const std::string& input) {
+	auto first = input.begin();
+	if (*first == '0') return decompress_blocks(std::string(first + 1, input.end()));
+	++first;
+	auto n = read_bits<32>(first);
+	huffman_decoder<char32_t> decoder;
+	first = decoder.read_table(first, code_point_codec{});
+
+	std::string result;
+	result.reserve(n);
+	while (n) {
+		--n;
+		utf8_encode(decoder.decode(first), result);
+	}
+	return result;
+}